@@ -0,0 +1,229 @@
+#pragma once
+#include <cassert>
+#include <deque>
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "minmax_heap.h"
+
+namespace misc {
+
+namespace details {
+/// @brief An element of an addressable_minmax_heap. It keeps the slot that
+/// records its position (1-based) in the heap up to date as it is moved
+/// around.
+template <typename T>
+struct addressable_node {
+  T value;
+  size_t* position;
+
+  addressable_node(T v, size_t* pos) : value(std::move(v)), position(pos) {}
+
+  addressable_node(const addressable_node&) = delete;
+  addressable_node(addressable_node&&) = default;
+  addressable_node& operator=(const addressable_node&) = delete;
+
+  // The moved-in element takes over this element's position. This element's
+  // slot is left alone, it's about to be released.
+  addressable_node& operator=(addressable_node&& o) noexcept(
+      std::is_nothrow_move_assignable_v<T>) {
+    if (this != &o) {
+      value = std::move(o.value);
+      *o.position = *position;
+      position = o.position;
+    }
+    return *this;
+  }
+
+  friend void swap(addressable_node& a, addressable_node& b) {
+    using std::swap;
+    swap(a.value, b.value);
+    swap(a.position, b.position);
+    swap(*a.position, *b.position);
+  }
+};
+
+template <typename Comp>
+struct addressable_compare {
+  Comp comp;
+
+  template <typename T>
+  [[nodiscard]] bool operator()(const addressable_node<T>& l,
+                                const addressable_node<T>& r) const {
+    return comp(l.value, r.value);
+  }
+};
+}  // namespace details
+
+/// @brief A min-max heap whose elements can be found, erased and re-keyed
+/// through the handle returned when they were pushed.
+/// @tparam T The element type
+/// @tparam Comp The comparison operator
+/// @note Handles stay valid until their element is popped or erased.
+template <typename T, typename Comp = std::less<T>>
+class addressable_minmax_heap
+    : protected minmax_heap<details::addressable_node<T>,
+                            details::addressable_compare<Comp>> {
+  using node_type = details::addressable_node<T>;
+  using base_type = minmax_heap<node_type, details::addressable_compare<Comp>>;
+  using index_type = typename base_type::index_type;
+
+ public:
+  using value_type = T;
+  using value_compare = Comp;
+  using size_type = typename base_type::size_type;
+  using const_reference = const T&;
+
+  class handle {
+    friend class addressable_minmax_heap;
+    size_t* m_position = nullptr;
+    explicit handle(size_t* position) : m_position(position) {}
+
+   public:
+    handle() = default;
+
+    [[nodiscard]] friend bool operator==(const handle& lhs,
+                                         const handle& rhs) {
+      return lhs.m_position == rhs.m_position;
+    }
+    [[nodiscard]] friend bool operator!=(const handle& lhs,
+                                         const handle& rhs) {
+      return !(lhs == rhs);
+    }
+  };
+
+  explicit addressable_minmax_heap(const value_compare& comp = value_compare{})
+      : base_type(details::addressable_compare<Comp>{comp}) {}
+
+  // Elements point into m_positions. Moving both keeps those pointers valid,
+  // copying doesn't.
+  addressable_minmax_heap(const addressable_minmax_heap&) = delete;
+  addressable_minmax_heap(addressable_minmax_heap&&) = default;
+  addressable_minmax_heap& operator=(const addressable_minmax_heap&) = delete;
+  addressable_minmax_heap& operator=(addressable_minmax_heap&&) = default;
+
+  using base_type::empty;
+  using base_type::size;
+
+  [[nodiscard]] const_reference front() const {
+    return base_type::front().value;
+  }
+  [[nodiscard]] const_reference back() const {
+    return base_type::back().value;
+  }
+
+  [[nodiscard]] handle front_handle() const {
+    return handle{base_type::front().position};
+  }
+  [[nodiscard]] handle back_handle() const {
+    return handle{base_type::back().position};
+  }
+
+  [[nodiscard]] const_reference operator[](handle h) const {
+    return this->elem(*h.m_position).value;
+  }
+
+  [[nodiscard]] value_compare value_comp() const { return this->m_comp.comp; }
+
+  handle push(const T& t) { return push(T(t)); }
+
+  handle push(T&& t) {
+    auto* position = acquire_position();
+    *position = size() + 1;
+    base_type::push(node_type{std::move(t), position});
+    return handle{position};
+  }
+
+  void pop_front() {
+    auto* position = base_type::front().position;
+    base_type::pop_front();
+    release_position(position);
+  }
+
+  void pop_back() {
+    auto* position = base_type::back().position;
+    base_type::pop_back();
+    release_position(position);
+  }
+
+  /// @brief Removes and returns the first element
+  [[nodiscard]] value_type pop_front_value() {
+    auto n = base_type::pop_front_value();
+    release_position(n.position);
+    return std::move(n.value);
+  }
+
+  /// @brief Removes and returns the last element
+  [[nodiscard]] value_type pop_back_value() {
+    auto n = base_type::pop_back_value();
+    release_position(n.position);
+    return std::move(n.value);
+  }
+
+  /// @brief Removes the element in O(log n)
+  void erase(handle h) {
+    base_type::erase_at(*h.m_position);
+    release_position(h.m_position);
+  }
+
+  /// @brief Replaces the element with any value in O(log n)
+  void update(handle h, T t) {
+    const auto i = *h.m_position;
+    this->elem(i).value = std::move(t);
+    this->fix(i);
+  }
+
+  /// @brief Replaces the element with a value that doesn't compare greater
+  void decrease(handle h, T t) {
+    const auto i = *h.m_position;
+    assert(!this->m_comp.comp(this->elem(i).value, t));
+    this->elem(i).value = std::move(t);
+    // On a min level, only min-level ancestors can be out of order now
+    if (this->is_on_min_level(i)) {
+      base_type::push(i, this->m_comp);
+    } else {
+      this->fix(i);
+    }
+  }
+
+  /// @brief Replaces the element with a value that doesn't compare less
+  void increase(handle h, T t) {
+    const auto i = *h.m_position;
+    assert(!this->m_comp.comp(t, this->elem(i).value));
+    this->elem(i).value = std::move(t);
+    // On a max level, only max-level ancestors can be out of order now
+    if (!this->is_on_min_level(i)) {
+      base_type::push(i, this->inv_comp());
+    } else {
+      this->fix(i);
+    }
+  }
+
+  void clear() {
+    this->m_heap.clear();
+    this->m_size = 0;
+    m_positions.clear();
+    m_free_positions.clear();
+  }
+
+ protected:
+  // A deque, so the addresses of the slots are stable
+  std::deque<size_t> m_positions;
+  std::vector<size_t*> m_free_positions;
+
+  size_t* acquire_position() {
+    if (m_free_positions.empty()) {
+      return &m_positions.emplace_back();
+    }
+    auto* position = m_free_positions.back();
+    m_free_positions.pop_back();
+    return position;
+  }
+
+  void release_position(size_t* position) {
+    m_free_positions.push_back(position);
+  }
+};
+
+}  // namespace misc
@@ -1,7 +1,10 @@
 #pragma once
 #include <algorithm>
+#include <array>
 #include <cstddef>
+#include <cstdlib>
 #include <memory>
+#include <memory_resource>
 #include <type_traits>
 #include <utility>
 
@@ -29,7 +32,9 @@ class arr_range {
 /// @brief Allocates space on the heap for multiple arrays with a single
 /// allocation.
 /// @tparam ...Args The type of each array
-/// @note Only space is allocated, objects are not created
+/// @note Only space is allocated, objects are not created. The space comes
+/// from std::aligned_alloc, or from a std::pmr::memory_resource if one is
+/// given.
 template <typename... Args>
 class allocated_storages {
  public:
@@ -43,7 +48,8 @@ class allocated_storages {
     allocate_storage();
   }
 
-  template <typename... Size>
+  template <typename... Size,
+            std::enable_if_t<(std::is_integral_v<Size> && ...), int> = 0>
   explicit allocated_storages(Size... sizes) {
     static_assert(sizeof...(Size) == sizeof...(Args));
 
@@ -52,6 +58,17 @@ class allocated_storages {
     allocate_storage();
   }
 
+  /// @param resource Where to allocate from. nullptr means std::aligned_alloc.
+  template <typename... Size>
+  explicit allocated_storages(std::pmr::memory_resource* resource,
+                              Size... sizes) {
+    static_assert(sizeof...(Size) == sizeof...(Args));
+
+    populate_spans(std::make_index_sequence<sizeof...(Args)>(), sizes...);
+
+    allocate_storage(resource);
+  }
+
   allocated_storages(const allocated_storages&) = default;
   allocated_storages(allocated_storages&&) = default;
 
@@ -76,9 +93,25 @@ class allocated_storages {
     return get<index_of_v<Type, Args...>>();
   }
 
+  /// @brief The resource the arrays were allocated from, or nullptr if they
+  /// came from std::aligned_alloc
+  [[nodiscard]] std::pmr::memory_resource* get_memory_resource() const {
+    return m_memory.get_deleter().resource;
+  }
+
  protected:
   struct freeing_deleter {
-    void operator()(void* ptr) const { std::free(ptr); }
+    std::pmr::memory_resource* resource = nullptr;
+    size_t bytes = 0;
+    size_t alignment = 0;
+
+    void operator()(std::byte* ptr) const {
+      if (resource) {
+        resource->deallocate(ptr, bytes, alignment);
+      } else {
+        std::free(ptr);
+      }
+    }
   };
   std::unique_ptr<std::byte, freeing_deleter> m_memory;
 
@@ -115,18 +148,26 @@ class allocated_storages {
     return m_other_spans[Ind - 1];
   }
 
-  void allocate_storage() {
+  void allocate_storage(std::pmr::memory_resource* resource = nullptr) {
     constexpr auto last_ind = sizeof...(Args) - 1;
     const auto [last_offset, last_arr_len] = get_span<last_ind>();
     const auto total_size =
         last_offset + sizeof(nth_type<last_ind>) * last_arr_len;
 
-    constexpr const auto arr_alignment = alignof(nth_type<0>[]);
+    // Every array's offset is aligned for it, relative to the start
+    constexpr const auto arr_alignment = std::max({alignof(Args[])...});
     auto round_up = total_size % arr_alignment;
     if (round_up > 0) round_up = arr_alignment - round_up;
+    const auto bytes = total_size + round_up;
 
-    m_memory.reset(reinterpret_cast<std::byte*>(
-        std::aligned_alloc(arr_alignment, total_size + round_up)));
+    if (resource) {
+      m_memory.reset(reinterpret_cast<std::byte*>(
+          resource->allocate(bytes, arr_alignment)));
+    } else {
+      m_memory.reset(reinterpret_cast<std::byte*>(
+          std::aligned_alloc(arr_alignment, bytes)));
+    }
+    m_memory.get_deleter() = freeing_deleter{resource, bytes, arr_alignment};
   }
 };
 
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <cassert>
+#include <climits>
+#include <cstdint>
+
+#if __cplusplus >= 202002L
+#include <bit>
+#elif defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace misc {
+
+/// @brief The number of consecutive 0 bits, starting from the least
+/// significant bit
+/// @param i The word to scan. Must not be 0.
+[[nodiscard]] inline int countr_zero(uint64_t i) {
+  assert(i != 0);
+#if __cplusplus >= 202002L
+  return std::countr_zero(i);
+#elif defined(_MSC_VER)
+  unsigned long retval;
+  _BitScanForward64(&retval, i);
+  return static_cast<int>(retval);
+#elif defined(__GNUC__) || defined(__clang__)
+  return __builtin_ctzll(i);
+#else
+  int retval = 0;
+  while (!(i & 1)) {
+    i >>= 1;
+    ++retval;
+  }
+  return retval;
+#endif
+}
+
+/// @brief The number of consecutive 0 bits, starting from the most
+/// significant bit
+/// @param i The word to scan. Must not be 0.
+[[nodiscard]] inline int countl_zero(uint64_t i) {
+  assert(i != 0);
+#if __cplusplus >= 202002L
+  return std::countl_zero(i);
+#elif defined(_MSC_VER)
+  unsigned long retval;
+  _BitScanReverse64(&retval, i);
+  return static_cast<int>(sizeof(i)) * CHAR_BIT - 1 - static_cast<int>(retval);
+#elif defined(__GNUC__) || defined(__clang__)
+  return __builtin_clzll(i);
+#else
+  int retval = 0;
+  while (!(i & (uint64_t{1} << 63))) {
+    i <<= 1;
+    ++retval;
+  }
+  return retval;
+#endif
+}
+
+/// @brief The number of 1 bits
+[[nodiscard]] inline int popcount(uint64_t i) {
+#if __cplusplus >= 202002L
+  return std::popcount(i);
+#elif defined(_MSC_VER)
+  return static_cast<int>(__popcnt64(i));
+#elif defined(__GNUC__) || defined(__clang__)
+  return __builtin_popcountll(i);
+#else
+  int retval = 0;
+  for (; i; i &= i - 1) ++retval;
+  return retval;
+#endif
+}
+
+}  // namespace misc
@@ -0,0 +1,203 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <utility>
+
+#include "allocated_storages.h"
+#include "bit_scan.h"
+
+namespace misc {
+
+/// @brief A fixed-capacity vector of optional elements, whose empty slots can
+/// be filled concurrently.
+/// @tparam T The element type
+/// @note A slot is claimed with an atomic fetch_or on its occupancy word, so
+/// threads filling different (or the same) slots need no lock, and exactly
+/// one try_emplace_at of a slot succeeds. Once constructed, the element is
+/// published with a release fetch_or on a second bitmap. Reads test that
+/// bitmap with acquire, so they only see fully constructed elements.
+/// Resetting, clearing and resizing must only be done when no other thread
+/// is using the vector.
+template <typename T>
+class concurrent_vector_of_optional {
+ protected:
+  using word_type = uint64_t;
+  using atomic_word = std::atomic<word_type>;
+
+  static constexpr size_t WORD_BITS = sizeof(word_type) * CHAR_BIT;
+  static constexpr size_t BITS_STORE_IND = 0;
+  static constexpr size_t DATA_STORE_IND = 1;
+
+ public:
+  using value_type = T;
+  using size_type = size_t;
+
+  /// @param capacity The number of slots
+  /// @param resource Where to allocate from. nullptr means std::aligned_alloc.
+  explicit concurrent_vector_of_optional(
+      size_t capacity = 0, std::pmr::memory_resource* resource = nullptr)
+      : m_storages(make_storages(capacity, resource)), m_capacity(capacity) {}
+
+  concurrent_vector_of_optional(const concurrent_vector_of_optional&) = delete;
+  concurrent_vector_of_optional& operator=(
+      const concurrent_vector_of_optional&) = delete;
+
+  ~concurrent_vector_of_optional() { clear(); }
+
+  /// @brief The number of slots. Fixed, apart from resize().
+  [[nodiscard]] size_t size() const { return m_capacity; }
+
+  /// @brief Constructs an element in an empty slot. Safe to call
+  /// concurrently, for any slots.
+  /// @return The element, or nullptr if the slot was already taken
+  template <typename... Args>
+  T* try_emplace_at(size_t pos, Args&&... args) {
+    assert(pos < m_capacity);
+    const auto mask = bit_mask(pos);
+    auto& claim = claimed()[pos / WORD_BITS];
+    if (claim.fetch_or(mask, std::memory_order_relaxed) & mask) {
+      return nullptr;
+    }
+
+    T* retval;
+    try {
+      retval = new (data() + pos) T(std::forward<Args>(args)...);
+    } catch (...) {
+      claim.fetch_and(~mask, std::memory_order_relaxed);
+      throw;
+    }
+    published()[pos / WORD_BITS].fetch_or(mask, std::memory_order_release);
+    return retval;
+  }
+
+  /// @brief Whether a slot's element has been published. Safe to call
+  /// concurrently with try_emplace_at.
+  [[nodiscard]] bool is_set(size_t pos) const {
+    return published()[pos / WORD_BITS].load(std::memory_order_acquire) &
+           bit_mask(pos);
+  }
+
+  /// @brief The slot's element, if it has been published. Safe to call
+  /// concurrently with try_emplace_at.
+  [[nodiscard]] T* operator[](size_t pos) {
+    return is_set(pos) ? data() + pos : nullptr;
+  }
+
+  [[nodiscard]] const T* operator[](size_t pos) const {
+    return const_cast<concurrent_vector_of_optional*>(this)->operator[](pos);
+  }
+
+  /// @brief The number of published elements. Only exact when no other
+  /// thread is emplacing.
+  [[nodiscard]] size_t count() const {
+    size_t retval = 0;
+    for (size_t w = 0; w < word_count(m_capacity); ++w) {
+      retval += static_cast<size_t>(
+          popcount(published()[w].load(std::memory_order_acquire)));
+    }
+    return retval;
+  }
+
+  /// @brief The first published slot at or after pos
+  /// @return The slot's index, or size() if there is none
+  [[nodiscard]] size_t next_set(size_t pos) const {
+    if (pos >= m_capacity) return m_capacity;
+    auto w = pos / WORD_BITS;
+    auto bits = published()[w].load(std::memory_order_acquire) &
+                (~word_type{0} << (pos % WORD_BITS));
+    while (bits == 0) {
+      if (++w == word_count(m_capacity)) return m_capacity;
+      bits = published()[w].load(std::memory_order_acquire);
+    }
+    return w * WORD_BITS + static_cast<size_t>(countr_zero(bits));
+  }
+
+  /// @brief Calls f(index, value) for each published element, in order
+  template <typename F>
+  void for_each_set(F&& f) {
+    for (auto i = next_set(0); i != m_capacity; i = next_set(i + 1)) {
+      f(i, data()[i]);
+    }
+  }
+
+  template <typename F>
+  void for_each_set(F&& f) const {
+    for (auto i = next_set(0); i != m_capacity; i = next_set(i + 1)) {
+      f(i, std::as_const(data()[i]));
+    }
+  }
+
+  /// @brief Destroys a slot's element. Not safe to call concurrently.
+  void reset(size_t pos) {
+    if (!is_set(pos)) return;
+    std::destroy_at(data() + pos);
+    const auto mask = ~bit_mask(pos);
+    claimed()[pos / WORD_BITS].fetch_and(mask, std::memory_order_relaxed);
+    published()[pos / WORD_BITS].fetch_and(mask, std::memory_order_relaxed);
+  }
+
+  /// @brief Destroys every element. Not safe to call concurrently.
+  void clear() {
+    for (auto i = next_set(0); i != m_capacity; i = next_set(i + 1)) {
+      reset(i);
+    }
+  }
+
+  /// @brief Changes the number of slots, moving the elements that remain.
+  /// Not safe to call concurrently.
+  void resize(size_t capacity) {
+    concurrent_vector_of_optional tmp(capacity, get_memory_resource());
+    for (auto i = next_set(0); i < std::min(capacity, m_capacity);
+         i = next_set(i + 1)) {
+      tmp.try_emplace_at(i, std::move(data()[i]));
+    }
+    clear();
+    std::swap(m_storages, tmp.m_storages);
+    std::swap(m_capacity, tmp.m_capacity);
+  }
+
+  [[nodiscard]] std::pmr::memory_resource* get_memory_resource() const {
+    return m_storages.get_memory_resource();
+  }
+
+ protected:
+  // The claimed words, followed by the published words
+  allocated_storages<atomic_word, T> m_storages;
+  size_t m_capacity;
+
+  static constexpr size_t word_count(size_t bits) {
+    return (bits + WORD_BITS - 1) / WORD_BITS;
+  }
+
+  static constexpr word_type bit_mask(size_t i) {
+    return word_type{1} << (i % WORD_BITS);
+  }
+
+  static allocated_storages<atomic_word, T> make_storages(
+      size_t capacity, std::pmr::memory_resource* resource) {
+    allocated_storages<atomic_word, T> storages{
+        resource, 2 * word_count(capacity), capacity};
+    for (auto& word : storages.template get<BITS_STORE_IND>()) {
+      new (&word) atomic_word{0};
+    }
+    return storages;
+  }
+
+  [[nodiscard]] atomic_word* claimed() const {
+    return m_storages.template get<BITS_STORE_IND>().begin();
+  }
+
+  [[nodiscard]] atomic_word* published() const {
+    return claimed() + word_count(m_capacity);
+  }
+
+  [[nodiscard]] T* data() const {
+    return m_storages.template get<DATA_STORE_IND>().begin();
+  }
+};
+
+}  // namespace misc
@@ -1,12 +1,25 @@
+#pragma once
 #include <boost/iterator/filter_iterator.hpp>
 #include <boost/iterator/transform_iterator.hpp>
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <mutex>
 #include <optional>
+#include <stdexcept>
+#include <thread>
+#include <type_traits>
 #include <utility>
+#include <vector>
 
+#include "parallel_for.h"
 #include "vector_of_optional.h"
 
 namespace misc {
 
+// The number of slots VectorOfOptional keeps in one occupancy word
+inline constexpr size_t OCCUPANCY_WORD_BITS = sizeof(uint64_t) * CHAR_BIT;
+
 struct identity {
   using is_transparent = void;
 
@@ -16,8 +29,102 @@ struct identity {
   }
 };
 
-template <typename Key, typename Value, typename KeyToIndexMap = identity>
-class dense_dynamic_index_map
+/// @brief Converts with static_cast, e.g. between an enum and its index
+template <typename To>
+struct cast_to {
+  template <typename From>
+  constexpr To operator()(From f) const noexcept {
+    return static_cast<To>(f);
+  }
+};
+
+/// @brief The IndexToKey a dense_dynamic_index_map uses by default: identity
+/// for size_t keys mapped by identity, and void (no inverse) otherwise
+template <typename Key, typename KeyToIndexMap>
+using default_index_to_key_t =
+    std::conditional_t<std::is_same_v<Key, size_t> &&
+                           std::is_same_v<KeyToIndexMap, identity>,
+                       identity, void>;
+
+namespace details {
+// Whether a KeyToIndexMap has an npos, the index it maps keys it doesn't know
+// to
+template <typename KeyToIndexMap, typename = void>
+struct has_npos : std::false_type {};
+
+template <typename KeyToIndexMap>
+struct has_npos<KeyToIndexMap, std::void_t<decltype(KeyToIndexMap::npos)>>
+    : std::true_type {};
+
+// Throws if the index is the KeyToIndexMap's npos, so an unknown key doesn't
+// get a slot
+template <typename KeyToIndexMap>
+void check_insert_index(size_t ind) {
+  if constexpr (has_npos<KeyToIndexMap>::value) {
+    if (ind == KeyToIndexMap::npos) {
+      throw std::out_of_range("dense_dynamic_index_map: unknown key");
+    }
+  }
+}
+
+// The parallel_for_each and parallel_reduce of both dense_dynamic_index_map
+// variants, over their VectorOfOptional. fn and transform are passed each
+// slot's index and value.
+template <typename Slots, typename Fn>
+void parallel_for_each_set(Slots& slots, size_t num_threads, Fn&& fn) {
+  parallel_for_aligned(slots.size(), OCCUPANCY_WORD_BITS, num_threads,
+                       [&](size_t first, size_t last) {
+                         slots.for_each_set(first, last, fn);
+                       });
+}
+
+template <typename Slots, typename T, typename Reduce, typename Transform>
+T parallel_reduce_set(const Slots& slots, T init, Reduce&& reduce,
+                      Transform&& transform, size_t num_threads) {
+  std::mutex partials_mutex;
+  std::vector<std::pair<size_t, T>> partials;
+  parallel_for_aligned(
+      slots.size(), OCCUPANCY_WORD_BITS, num_threads,
+      [&](size_t first, size_t last) {
+        std::optional<T> acc;
+        slots.for_each_set(first, last, [&](size_t i, const auto& v) {
+          if (acc) {
+            acc = reduce(std::move(*acc), transform(i, v));
+          } else {
+            acc.emplace(transform(i, v));
+          }
+        });
+        if (acc) {
+          std::lock_guard lock{partials_mutex};
+          partials.emplace_back(first, std::move(*acc));
+        }
+      });
+
+  std::sort(partials.begin(), partials.end(),
+            [](const auto& lhs, const auto& rhs) {
+              return lhs.first < rhs.first;
+            });
+  for (auto& [first, partial] : partials) {
+    init = reduce(std::move(init), std::move(partial));
+  }
+  return init;
+}
+}  // namespace details
+
+/// @brief A map from keys to values, stored in the slot of a vector of
+/// optionals that KeyToIndexMap maps each key to.
+/// @tparam IndexToKey The inverse of KeyToIndexMap, or void if there is none.
+/// With an inverse, slots hold only the value and iterators rebuild the key
+/// from the slot's index. Without one, slots hold the key too.
+/// @note If KeyToIndexMap has a static npos that it maps unknown keys to (as
+/// perfect_hash_index does), operator[] and emplace throw std::out_of_range
+/// for those keys instead of giving them a slot.
+template <typename Key, typename Value, typename KeyToIndexMap = identity,
+          typename IndexToKey = default_index_to_key_t<Key, KeyToIndexMap>>
+class dense_dynamic_index_map;
+
+template <typename Key, typename Value, typename KeyToIndexMap>
+class dense_dynamic_index_map<Key, Value, KeyToIndexMap, void>
     : protected VectorOfOptional<std::pair<const Key, Value>> {
   KeyToIndexMap index_map;
   using base_type = VectorOfOptional<std::pair<const Key, Value>>;
@@ -40,7 +147,7 @@ class dense_dynamic_index_map
     friend class dense_dynamic_index_map;
 
     iterator(size_t i, dense_dynamic_index_map& map) : ind(i), arr(map) {
-      while (ind != arr.base_type::size() && !arr.is_set(ind)) ++ind;
+      ind = arr.next_set(ind);
     }
 
     reference operator*() { return *arr.base_type::operator[](ind); }
@@ -52,8 +159,7 @@ class dense_dynamic_index_map
     pointer operator->() const { return arr.base_type::operator[](ind); }
 
     iterator& operator++() {
-      while (ind != arr.base_type::size() && !arr.is_set(++ind))
-        ;
+      ind = arr.next_set(ind + 1);
       return *this;
     }
     iterator operator++(int) {
@@ -62,8 +168,7 @@ class dense_dynamic_index_map
       return retval;
     }
     iterator& operator--() {
-      while (ind != 0 && !arr.is_set(--ind))
-        ;
+      ind = arr.prev_set(ind);
       return *this;
     }
     iterator operator--(int) {
@@ -93,18 +198,17 @@ class dense_dynamic_index_map
 
     friend class dense_dynamic_index_map;
 
-    const_iterator(iterator it) : ind(it.i), arr(it.arr) {}
+    const_iterator(iterator it) : ind(it.ind), arr(it.arr) {}
     const_iterator(size_t i, const dense_dynamic_index_map& map)
         : ind(i), arr(map) {
-      while (ind != arr.base_type::size() && !arr.is_set(ind)) ++ind;
+      ind = arr.next_set(ind);
     }
 
     reference operator*() const { return *arr.base_type::operator[](ind); }
     pointer operator->() const { return arr.base_type::operator[](ind); }
 
     const_iterator& operator++() {
-      while (ind != arr.base_type::size() && !arr.is_set(++ind))
-        ;
+      ind = arr.next_set(ind + 1);
       return *this;
     }
     const_iterator operator++(int) {
@@ -113,8 +217,7 @@ class dense_dynamic_index_map
       return retval;
     }
     const_iterator& operator--() {
-      while (ind != 0 && !arr.is_set(--ind))
-        ;
+      ind = arr.prev_set(ind);
       return *this;
     }
     const_iterator operator--(int) {
@@ -149,7 +252,7 @@ class dense_dynamic_index_map
 
   [[nodiscard]] const_iterator find(const Key& key) const {
     const auto ind = index_map(key);
-    if (this->is_set(ind)) {
+    if (ind < base_type::size() && this->is_set(ind)) {
       return const_iterator{ind, *this};
     }
     return end();
@@ -157,43 +260,51 @@ class dense_dynamic_index_map
 
   [[nodiscard]] iterator find(const Key& key) {
     const auto ind = index_map(key);
-    if (this->is_set(ind)) {
+    if (ind < base_type::size() && this->is_set(ind)) {
       return iterator{ind, *this};
     }
     return end();
   }
 
+  /// @brief Destroys the element and empties its slot. No other element
+  /// moves, so every other key keeps its slot.
+  /// @return The iterator after the erased element
   const_iterator erase(const_iterator it) {
     if (!this->is_set(it.ind)) return end();
-
-    base_type::erase(it.ind);
-    return it++;
+    base_type::reset(it.ind);
+    return ++it;
   }
   iterator erase(iterator it) {
     if (!this->is_set(it.ind)) return end();
-    base_type::erase(it.ind);
-    return it++;
+    base_type::reset(it.ind);
+    return ++it;
+  }
+
+  /// @brief Drops the empty slots after the last element, so end() and
+  /// backward iteration don't have to skip them
+  void trim() {
+    const auto last = this->prev_set(base_type::size());
+    base_type::resize(last == base_type::npos ? 0 : last + 1);
   }
 
   [[nodiscard]] Value& operator[](Key key) {
     const auto ind = index_map(key);
+    details::check_insert_index<KeyToIndexMap>(ind);
     if (ind < base_type::size()) {
       if (auto* v = base_type::operator[](ind)) {
         return v->second;
       }
       return base_type::emplace_at(ind, key, Value{})->second;
     } else {
-      reserve(ind + 1);
-      for (size_t i = base_type::size(); i < ind; ++i) {
-        base_type::emplace_back(std::nullopt);
-      }
-      return base_type::emplace_back(key, Value{})->second;
+      grow_to(ind + 1);
+      return base_type::emplace_at(ind, key, Value{})->second;
     }
   }
 
   template <typename... Args>
   std::pair<iterator, bool> emplace(const Key& key, Args&&... args) {
     const auto ind = index_map(key);
+    details::check_insert_index<KeyToIndexMap>(ind);
     if (ind < base_type::size()) {
       if (this->is_set(ind)) {
         return {{ind, *this}, false};
@@ -202,26 +313,67 @@ class dense_dynamic_index_map
       return {{ind, *this}, true};
     }
 
-    reserve(ind + 1);
-    for (size_t i = base_type::size(); i < ind; ++i) {
-      base_type::emplace_back(std::nullopt);
-    }
-    base_type::emplace_back(key, std::forward<Args>(args)...);
+    grow_to(ind + 1);
+    base_type::emplace_at(ind, key, std::forward<Args>(args)...);
     return {{ind, *this}, true};
   }
 
+  /// @brief Calls fn(key, value) for every element, from up to num_threads
+  /// threads
+  /// @note Each thread gets a contiguous run of slots, split at occupancy
+  /// word boundaries, so no two threads touch the same word. fn must be safe
+  /// to call concurrently for different elements.
+  template <typename Fn>
+  void parallel_for_each(
+      Fn&& fn, size_t num_threads = std::thread::hardware_concurrency()) {
+    details::parallel_for_each_set(static_cast<base_type&>(*this), num_threads,
+                                   [&](size_t, auto& v) {
+                                     fn(v.first, v.second);
+                                   });
+  }
+
+  /// @brief Folds transform(key, value) of every element into init with
+  /// reduce, from up to num_threads threads
+  /// @note The slots are split like parallel_for_each. Each thread folds its
+  /// own slots in order, and their results are then folded into init in slot
+  /// order, so reduce must be associative, but needn't be commutative.
+  template <typename T, typename Reduce, typename Transform>
+  T parallel_reduce(
+      T init, Reduce reduce, Transform transform,
+      size_t num_threads = std::thread::hardware_concurrency()) const {
+    return details::parallel_reduce_set(
+        static_cast<const base_type&>(*this), std::move(init), reduce,
+        [&](size_t, const auto& v) { return transform(v.first, v.second); },
+        num_threads);
+  }
+
   void reserve(size_t s) { base_type::reserve(s); }
+
+ protected:
+  // Grows the capacity geometrically, so inserting keys in increasing order
+  // is amortized O(1)
+  void grow_to(size_t s) {
+    if (s > base_type::capacity()) {
+      reserve(std::max(s, 2 * base_type::capacity()));
+    }
+    base_type::resize(s);
+  }
 };
 
-template <typename Value>
-class dense_dynamic_index_map<size_t, Value, identity>
-    : protected VectorOfOptional<Value> {
-  using KeyToIndexMap = identity;
+template <typename Key, typename Value, typename KeyToIndexMap,
+          typename IndexToKey>
+class dense_dynamic_index_map : protected VectorOfOptional<Value> {
+  KeyToIndexMap index_map;
+  IndexToKey index_to_key;
   using base_type = VectorOfOptional<Value>;
-  using Key = size_t;
 
  public:
-  dense_dynamic_index_map(size_t init_count = 0) { reserve(init_count); }
+  dense_dynamic_index_map(size_t init_count = 0,
+                          KeyToIndexMap m = KeyToIndexMap{},
+                          IndexToKey inverse = IndexToKey{})
+      : index_map(std::move(m)), index_to_key(std::move(inverse)) {
+    reserve(init_count);
+  }
 
   struct iterator {
     struct wrapper {
@@ -247,28 +399,28 @@ class dense_dynamic_index_map<size_t, Value, identity>
     friend class dense_dynamic_index_map;
 
     iterator(size_t i, dense_dynamic_index_map& map) : ind(i), arr(map) {
-      while (ind != arr.base_type::size() && !arr.is_set(ind)) ++ind;
+      ind = arr.next_set(ind);
     }
 
     reference operator*() {
-      return reference{ind, *arr.base_type::operator[](ind)};
+      return reference{arr.index_to_key(ind), *arr.base_type::operator[](ind)};
     }
     const_reference operator*() const {
-      return const_reference{ind, *arr.base_type::operator[](ind)};
+      return const_reference{arr.index_to_key(ind),
+                             *arr.base_type::operator[](ind)};
     }
 
     pointer operator->() {
-      return wrapper{
-          std::pair<const Key, Value&>{ind, *arr.base_type::operator[](ind)}};
+      return wrapper{std::pair<const Key, Value&>{
+          arr.index_to_key(ind), *arr.base_type::operator[](ind)}};
     }
     const_pointer operator->() const {
       return const_wrapper{std::pair<const Key, const Value&>{
-          ind, *arr.base_type::operator[](ind)}};
+          arr.index_to_key(ind), *arr.base_type::operator[](ind)}};
     }
 
     iterator& operator++() {
-      while (ind != arr.base_type::size() && !arr.is_set(++ind))
-        ;
+      ind = arr.next_set(ind + 1);
       return *this;
     }
     iterator operator++(int) {
@@ -277,8 +429,7 @@ class dense_dynamic_index_map<size_t, Value, identity>
       return retval;
     }
     iterator& operator--() {
-      while (ind != 0 && !arr.is_set(--ind))
-        ;
+      ind = arr.prev_set(ind);
       return *this;
     }
     iterator operator--(int) {
@@ -315,22 +466,22 @@ class dense_dynamic_index_map<size_t, Value, identity>
 
     friend class dense_dynamic_index_map;
 
-    const_iterator(iterator it) : ind(it.i), arr(it.arr) {}
+    const_iterator(iterator it) : ind(it.ind), arr(it.arr) {}
     const_iterator(size_t i, const dense_dynamic_index_map& map)
         : ind(i), arr(map) {
-      while (ind != arr.base_type::size() && !arr.is_set(ind)) ++ind;
+      ind = arr.next_set(ind);
     }
 
     reference operator*() const {
-      return {ind, *arr.base_type::operator[](ind)};
+      return {arr.index_to_key(ind), *arr.base_type::operator[](ind)};
     }
     pointer operator->() const {
-      return wrapper{std::pair{ind, arr.base_type::operator[](ind)}};
+      return wrapper{std::pair<const Key, const Value&>{
+          arr.index_to_key(ind), *arr.base_type::operator[](ind)}};
     }
 
     const_iterator& operator++() {
-      while (ind != arr.base_type::size() && !arr.is_set(++ind))
-        ;
+      ind = arr.next_set(ind + 1);
       return *this;
     }
     const_iterator operator++(int) {
@@ -339,8 +490,7 @@ class dense_dynamic_index_map<size_t, Value, identity>
       return retval;
     }
     const_iterator& operator--() {
-      while (ind != 0 && !arr.is_set(--ind))
-        ;
+      ind = arr.prev_set(ind);
       return *this;
     }
     const_iterator operator--(int) {
@@ -374,52 +524,60 @@ class dense_dynamic_index_map<size_t, Value, identity>
   }
 
   [[nodiscard]] const_iterator find(const Key& key) const {
-    const auto ind = key;
-    if (this->is_set(ind)) {
+    const auto ind = index_map(key);
+    if (ind < base_type::size() && this->is_set(ind)) {
       return const_iterator{ind, *this};
     }
     return end();
   }
 
   [[nodiscard]] iterator find(const Key& key) {
-    const auto ind = key;
-    if (this->is_set(ind)) {
+    const auto ind = index_map(key);
+    if (ind < base_type::size() && this->is_set(ind)) {
       return iterator{ind, *this};
     }
     return end();
   }
 
+  /// @brief Destroys the element and empties its slot. No other element
+  /// moves, so every other key keeps its slot.
+  /// @return The iterator after the erased element
   const_iterator erase(const_iterator it) {
     if (!this->is_set(it.ind)) return end();
-
-    base_type::erase(it.ind);
-    return it++;
+    base_type::reset(it.ind);
+    return ++it;
   }
   iterator erase(iterator it) {
     if (!this->is_set(it.ind)) return end();
-    base_type::erase(it.ind);
-    return it++;
+    base_type::reset(it.ind);
+    return ++it;
+  }
+
+  /// @brief Drops the empty slots after the last element, so end() and
+  /// backward iteration don't have to skip them
+  void trim() {
+    const auto last = this->prev_set(base_type::size());
+    base_type::resize(last == base_type::npos ? 0 : last + 1);
   }
 
   [[nodiscard]] Value& operator[](Key key) {
-    const auto ind = key;
+    const auto ind = index_map(key);
+    details::check_insert_index<KeyToIndexMap>(ind);
     if (ind < base_type::size()) {
       if (auto* v = base_type::operator[](ind)) {
         return *v;
       }
       return *base_type::emplace_at(ind, Value{});
     } else {
-      reserve(ind + 1);
-      for (size_t i = base_type::size(); i < ind; ++i) {
-        base_type::emplace_back(std::nullopt);
-      }
-      return *base_type::emplace_back(Value{});
+      grow_to(ind + 1);
+      return *base_type::emplace_at(ind, Value{});
     }
   }
 
   template <typename... Args>
   std::pair<iterator, bool> emplace(const Key& key, Args&&... args) {
-    const auto ind = key;
+    const auto ind = index_map(key);
+    details::check_insert_index<KeyToIndexMap>(ind);
     if (ind < base_type::size()) {
       if (this->is_set(ind)) {
         return {{ind, *this}, false};
@@ -428,15 +586,53 @@ class dense_dynamic_index_map<size_t, Value, identity>
       return {{ind, *this}, true};
     }
 
-    reserve(ind + 1);
-    for (size_t i = base_type::size(); i < ind; ++i) {
-      base_type::emplace_back(std::nullopt);
-    }
-    base_type::emplace_back(std::forward<Args>(args)...);
+    grow_to(ind + 1);
+    base_type::emplace_at(ind, std::forward<Args>(args)...);
     return {{ind, *this}, true};
   }
 
+  /// @brief Calls fn(key, value) for every element, from up to num_threads
+  /// threads
+  /// @note Each thread gets a contiguous run of slots, split at occupancy
+  /// word boundaries, so no two threads touch the same word. fn must be safe
+  /// to call concurrently for different elements.
+  template <typename Fn>
+  void parallel_for_each(
+      Fn&& fn, size_t num_threads = std::thread::hardware_concurrency()) {
+    details::parallel_for_each_set(static_cast<base_type&>(*this), num_threads,
+                                   [&](size_t i, Value& v) {
+                                     fn(index_to_key(i), v);
+                                   });
+  }
+
+  /// @brief Folds transform(key, value) of every element into init with
+  /// reduce, from up to num_threads threads
+  /// @note The slots are split like parallel_for_each. Each thread folds its
+  /// own slots in order, and their results are then folded into init in slot
+  /// order, so reduce must be associative, but needn't be commutative.
+  template <typename T, typename Reduce, typename Transform>
+  T parallel_reduce(
+      T init, Reduce reduce, Transform transform,
+      size_t num_threads = std::thread::hardware_concurrency()) const {
+    return details::parallel_reduce_set(
+        static_cast<const base_type&>(*this), std::move(init), reduce,
+        [&](size_t i, const Value& v) {
+          return transform(index_to_key(i), v);
+        },
+        num_threads);
+  }
+
   void reserve(size_t s) { base_type::reserve(s); }
+
+ protected:
+  // Grows the capacity geometrically, so inserting keys in increasing order
+  // is amortized O(1)
+  void grow_to(size_t s) {
+    if (s > base_type::capacity()) {
+      reserve(std::max(s, 2 * base_type::capacity()));
+    }
+    base_type::resize(s);
+  }
 };
 
 }  // namespace misc
\ No newline at end of file
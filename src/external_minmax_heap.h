@@ -0,0 +1,376 @@
+#pragma once
+#include <sys/types.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <cstdio>
+#include <functional>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "fopen_ptr.h"
+#include "minmax_heap.h"
+
+namespace misc {
+
+/// @brief A min-max heap that can grow larger than memory.
+/// @tparam T The element type. It's written to disk as raw bytes, so it must
+/// be trivially copyable.
+/// @tparam Comp The comparison operator
+/// @note Pushed elements go into an in-memory minmax_heap. When that reaches
+/// its share of the memory budget, it is sorted and written out to a
+/// temporary file as one run, with a single large write. Each run is read back
+/// lazily, a block at a time, from whichever end is being popped. Finding the
+/// front (or back) looks at the in-memory heap and the front (or back) of
+/// every run, so pops are O(log n + number of runs). Half of the budget goes
+/// to the in-memory heap, and half to the (up to) two blocks each run holds.
+/// When a spill leaves more runs than that half has room for, the smallest
+/// runs are merged into one, which keeps the number of runs, and so the cost
+/// of a pop, bounded.
+template <typename T, typename Comp = std::less<T>>
+class external_minmax_heap {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+ public:
+  using heap_type = minmax_heap<T, Comp>;
+  using value_type = T;
+  using value_compare = Comp;
+  using size_type = size_t;
+  using const_reference = const T&;
+
+  /// @param memory_budget The number of bytes the in-memory heap and the
+  /// blocks read from the runs may use
+  /// @param block_size The number of bytes read from a run at a time. Each run
+  /// may hold a block from each end in memory. It should be well under the
+  /// budget: at least two runs are allowed, whatever the budget.
+  explicit external_minmax_heap(size_t memory_budget,
+                                size_t block_size = size_t{1} << 20,
+                                const value_compare& comp = value_compare{})
+      : m_buffer(comp),
+        m_buffer_capacity(std::max<size_t>(memory_budget / 2 / sizeof(T), 1)),
+        m_block_len(std::max<size_t>(block_size / sizeof(T), 1)),
+        m_max_runs(std::max<size_t>(
+            memory_budget / 2 / (2 * m_block_len * sizeof(T)), 2)),
+        m_comp(comp) {}
+
+  [[nodiscard]] bool empty() const { return m_size == 0; }
+
+  [[nodiscard]] size_type size() const { return m_size; }
+
+  /// @brief The number of runs spilled to disk that still hold elements
+  [[nodiscard]] size_t run_count() const { return m_runs.size(); }
+
+  [[nodiscard]] const_reference front() const {
+    assert(!empty());
+    const auto [ind, from_buffer] = find_front();
+    return from_buffer ? m_buffer.front() : m_runs[ind].front();
+  }
+
+  [[nodiscard]] const_reference back() const {
+    assert(!empty());
+    const auto [ind, from_buffer] = find_back();
+    return from_buffer ? m_buffer.back() : m_runs[ind].back();
+  }
+
+  void push(const T& t) {
+    if (m_buffer.size() >= m_buffer_capacity) {
+      spill();
+    }
+    m_buffer.push(t);
+    ++m_size;
+  }
+
+  void pop_front() {
+    assert(!empty());
+    const auto [ind, from_buffer] = find_front();
+    if (from_buffer) {
+      m_buffer.pop_front();
+    } else {
+      m_runs[ind].pop_front();
+      remove_if_empty(ind);
+    }
+    --m_size;
+  }
+
+  void pop_back() {
+    assert(!empty());
+    const auto [ind, from_buffer] = find_back();
+    if (from_buffer) {
+      m_buffer.pop_back();
+    } else {
+      m_runs[ind].pop_back();
+      remove_if_empty(ind);
+    }
+    --m_size;
+  }
+
+  [[nodiscard]] value_compare value_comp() const { return m_comp; }
+
+ protected:
+  // A sorted run in a temporary file. Elements in [lo, hi) are still on
+  // disk. A block read from each end is kept in memory.
+  class run {
+    file_ptr m_file;
+    size_t m_lo = 0;
+    size_t m_hi = 0;
+    size_t m_block_len;
+
+    // Ascending. Each block's elements are the window [begin, end), which
+    // shrinks from both ends: once the disk range is empty, the last elements
+    // are popped from whichever block still holds them, without moving them.
+    std::vector<T> m_front_block;
+    size_t m_front_begin = 0;
+    size_t m_front_end = 0;
+    std::vector<T> m_back_block;
+    size_t m_back_begin = 0;
+    size_t m_back_end = 0;
+
+    void read(std::vector<T>& block, size_t first, size_t last) const {
+      block.resize(last - first);
+      if (::fseeko(m_file.get(), static_cast<off_t>(first * sizeof(T)),
+                   SEEK_SET) != 0) {
+        throw std::system_error(errno, std::generic_category(),
+                                "seeking in external_minmax_heap run");
+      }
+      // A short read doesn't reliably set errno
+      if (std::fread(block.data(), sizeof(T), block.size(), m_file.get()) !=
+          block.size()) {
+        throw std::system_error(std::make_error_code(std::errc::io_error),
+                                "reading external_minmax_heap run");
+      }
+    }
+
+    [[nodiscard]] bool front_block_empty() const {
+      return m_front_begin == m_front_end;
+    }
+
+    [[nodiscard]] bool back_block_empty() const {
+      return m_back_begin == m_back_end;
+    }
+
+    void load_front() {
+      if (!front_block_empty() || m_lo == m_hi) return;
+      const auto last = std::min(m_lo + m_block_len, m_hi);
+      read(m_front_block, m_lo, last);
+      m_lo = last;
+      m_front_begin = 0;
+      m_front_end = m_front_block.size();
+    }
+
+    void load_back() {
+      if (!back_block_empty() || m_lo == m_hi) return;
+      const auto first = m_hi - std::min(m_block_len, m_hi - m_lo);
+      read(m_back_block, first, m_hi);
+      m_hi = first;
+      m_back_begin = 0;
+      m_back_end = m_back_block.size();
+    }
+
+   public:
+    // An empty run, in a new temporary file
+    explicit run(size_t block_len)
+        : m_file(tmpfile_ptr()), m_block_len(block_len) {
+      if (!m_file) {
+        throw std::system_error(errno, std::generic_category(),
+                                "creating external_minmax_heap run");
+      }
+    }
+
+    run(const std::vector<T>& sorted, size_t block_len) : run(block_len) {
+      append(sorted.data(), sorted.size());
+    }
+
+    // Writes elements after the run's last one. Only for a run that hasn't
+    // been read from.
+    void append(const T* first, size_t n) {
+      assert(m_lo == 0 && m_front_block.empty() && m_back_block.empty());
+      // A short write doesn't reliably set errno
+      if (std::fwrite(first, sizeof(T), n, m_file.get()) != n) {
+        throw std::system_error(std::make_error_code(std::errc::io_error),
+                                "writing external_minmax_heap run");
+      }
+      m_hi += n;
+    }
+
+    // Reads a run's elements in order, a block at a time, without taking
+    // them out of the run
+    class reader {
+      const run* m_run;
+      std::vector<T> m_block;
+      const T* m_it;
+      const T* m_end;
+      size_t m_next;
+      bool m_in_back_block = false;
+
+      // Moves on to the next range with elements left: the front block, then
+      // the elements on disk, then the back block
+      void next_range() {
+        while (m_it == m_end) {
+          if (m_next != m_run->m_hi) {
+            const auto last =
+                std::min(m_next + m_run->m_block_len, m_run->m_hi);
+            m_run->read(m_block, m_next, last);
+            m_next = last;
+            m_it = m_block.data();
+            m_end = m_it + m_block.size();
+          } else if (!m_in_back_block) {
+            m_in_back_block = true;
+            m_it = m_run->m_back_block.data() + m_run->m_back_begin;
+            m_end = m_run->m_back_block.data() + m_run->m_back_end;
+          } else {
+            return;
+          }
+        }
+      }
+
+     public:
+      explicit reader(const run& r)
+          : m_run(&r),
+            m_it(r.m_front_block.data() + r.m_front_begin),
+            m_end(r.m_front_block.data() + r.m_front_end),
+            m_next(r.m_lo) {
+        next_range();
+      }
+
+      [[nodiscard]] bool done() const { return m_it == m_end; }
+
+      [[nodiscard]] const T& front() const { return *m_it; }
+
+      void pop_front() {
+        ++m_it;
+        next_range();
+      }
+    };
+
+    [[nodiscard]] size_t size() const {
+      return (m_hi - m_lo) + (m_front_end - m_front_begin) +
+             (m_back_end - m_back_begin);
+    }
+
+    [[nodiscard]] const T& front() {
+      load_front();
+      return front_block_empty() ? m_back_block[m_back_begin]
+                                 : m_front_block[m_front_begin];
+    }
+
+    [[nodiscard]] const T& back() {
+      load_back();
+      return back_block_empty() ? m_front_block[m_front_end - 1]
+                                : m_back_block[m_back_end - 1];
+    }
+
+    void pop_front() {
+      load_front();
+      ++(front_block_empty() ? m_back_begin : m_front_begin);
+    }
+
+    void pop_back() {
+      load_back();
+      --(back_block_empty() ? m_front_end : m_back_end);
+    }
+  };
+
+  heap_type m_buffer;
+  size_t m_buffer_capacity;
+  size_t m_block_len;
+  size_t m_max_runs;
+  // Runs read their blocks lazily, even through const accessors
+  mutable std::vector<run> m_runs;
+  size_type m_size = 0;
+  value_compare m_comp;
+
+  void spill() {
+    auto seq = m_buffer.extract_sequence();
+    std::sort(seq.begin(), seq.end(), m_comp);
+    try {
+      m_runs.emplace_back(seq, m_block_len);
+    } catch (...) {
+      // Keep the elements in memory
+      m_buffer.adopt_sequence(std::move(seq));
+      throw;
+    }
+    // Reuse the allocation
+    seq.clear();
+    m_buffer.adopt_sequence(std::move(seq));
+
+    if (m_runs.size() > m_max_runs) {
+      merge_smallest_runs(m_max_runs / 2 + 1);
+    }
+  }
+
+  // Merges the n smallest runs into a new one. The runs are only replaced
+  // once the new one is written, so a failed merge loses nothing. While it
+  // runs, each merged run and the new one hold one more block in memory.
+  void merge_smallest_runs(size_t n) {
+    std::sort(m_runs.begin(), m_runs.end(),
+              [](const run& a, const run& b) { return a.size() < b.size(); });
+    const auto merged_end = m_runs.begin() + static_cast<std::ptrdiff_t>(n);
+
+    std::vector<typename run::reader> readers;
+    readers.reserve(n);
+    for (auto it = m_runs.begin(); it != merged_end; ++it) {
+      readers.emplace_back(*it);
+    }
+
+    run merged(m_block_len);
+    std::vector<T> block;
+    block.reserve(m_block_len);
+    while (true) {
+      typename run::reader* best = nullptr;
+      for (auto& r : readers) {
+        if (!r.done() && (!best || m_comp(r.front(), best->front()))) {
+          best = &r;
+        }
+      }
+      if (!best || block.size() == m_block_len) {
+        merged.append(block.data(), block.size());
+        block.clear();
+      }
+      if (!best) break;
+      block.push_back(best->front());
+      best->pop_front();
+    }
+
+    m_runs.erase(m_runs.begin(), merged_end);
+    m_runs.push_back(std::move(merged));
+  }
+
+  void remove_if_empty(size_t run_ind) {
+    if (m_runs[run_ind].size() == 0) {
+      m_runs.erase(m_runs.begin() + static_cast<std::ptrdiff_t>(run_ind));
+    }
+  }
+
+  // Returns the index of the run holding the front, or whether it's the
+  // in-memory heap
+  [[nodiscard]] std::pair<size_t, bool> find_front() const {
+    const T* best = m_buffer.empty() ? nullptr : &m_buffer.front();
+    std::pair<size_t, bool> retval{0, best != nullptr};
+    for (size_t i = 0; i < m_runs.size(); ++i) {
+      const auto& candidate = m_runs[i].front();
+      if (!best || m_comp(candidate, *best)) {
+        best = &candidate;
+        retval = {i, false};
+      }
+    }
+    return retval;
+  }
+
+  [[nodiscard]] std::pair<size_t, bool> find_back() const {
+    const T* best = m_buffer.empty() ? nullptr : &m_buffer.back();
+    std::pair<size_t, bool> retval{0, best != nullptr};
+    for (size_t i = 0; i < m_runs.size(); ++i) {
+      const auto& candidate = m_runs[i].back();
+      if (!best || m_comp(*best, candidate)) {
+        best = &candidate;
+        retval = {i, false};
+      }
+    }
+    return retval;
+  }
+};
+
+}  // namespace misc
@@ -0,0 +1,136 @@
+#pragma once
+#include <functional>
+#include <utility>
+#include <vector>
+
+#include "minmax_heap.h"
+
+namespace misc {
+
+/// @brief Selects the k smallest and the k largest elements of a stream,
+/// using constant memory.
+/// @tparam T The element type
+/// @tparam Comp The comparison operator
+/// @note Each set is kept in its own bounded minmax_heap. One heap can't hold
+/// both: once more than 2k elements have been seen, the element to evict is
+/// the (k+1)th smallest or largest, in the middle of the order, where a
+/// min-max heap gives no access. In each heap, the inner end (the smallest
+/// set's back(), the largest set's front()) is the element evicted next, and
+/// the outer end is the most extreme element. Candidates that can't enter
+/// either set are rejected with two comparisons. Once 2k elements have been
+/// seen, the sets are disjoint, so a candidate enters at most one of them.
+template <typename T, typename Comp = std::less<T>>
+class extremes_selector {
+ public:
+  using heap_type = minmax_heap<T, Comp>;
+  using value_type = T;
+  using value_compare = Comp;
+  using size_type = typename heap_type::size_type;
+
+  explicit extremes_selector(size_type k,
+                             const value_compare& comp = value_compare{})
+      : m_smallest(comp), m_largest(comp), m_k(k), m_comp(comp) {}
+
+  [[nodiscard]] size_type capacity() const { return m_k; }
+
+  /// @brief The k smallest elements seen (or fewer, if fewer were pushed).
+  /// Its back() is the largest of them.
+  [[nodiscard]] const heap_type& smallest() const { return m_smallest; }
+
+  /// @brief The k largest elements seen (or fewer, if fewer were pushed).
+  /// Its front() is the smallest of them.
+  [[nodiscard]] const heap_type& largest() const { return m_largest; }
+
+  /// @brief Offers an element to both sets
+  /// @return true if the element was kept in either set
+  bool push(const T& t) {
+    const bool kept_smallest = push_smallest(t);
+    const bool kept_largest = push_largest(t);
+    return kept_smallest || kept_largest;
+  }
+
+  bool push(T&& t) {
+    // Only copy t when both sets keep it
+    if (!fits_largest(t)) return push_smallest(std::move(t));
+    push_smallest(t);
+    push_largest(std::move(t));
+    return true;
+  }
+
+  /// @brief Combines the elements selected by another selector into this one,
+  /// e.g. when reducing per-thread selectors.
+  void merge(extremes_selector&& o) {
+    auto smallest = o.m_smallest.extract_sequence();
+    for (auto& t : smallest) {
+      push_smallest(std::move(t));
+    }
+    auto largest = o.m_largest.extract_sequence();
+    for (auto& t : largest) {
+      push_largest(std::move(t));
+    }
+  }
+
+  void merge(const extremes_selector& o) { merge(extremes_selector{o}); }
+
+  /// @brief Removes the k smallest elements
+  /// @return The elements, from the smallest
+  [[nodiscard]] std::vector<T> extract_smallest() {
+    std::vector<T> retval;
+    retval.reserve(m_smallest.size());
+    while (!m_smallest.empty()) {
+      retval.push_back(m_smallest.pop_front_value());
+    }
+    return retval;
+  }
+
+  /// @brief Removes the k largest elements
+  /// @return The elements, from the largest
+  [[nodiscard]] std::vector<T> extract_largest() {
+    std::vector<T> retval;
+    retval.reserve(m_largest.size());
+    while (!m_largest.empty()) {
+      retval.push_back(m_largest.pop_back_value());
+    }
+    return retval;
+  }
+
+ protected:
+  heap_type m_smallest;
+  heap_type m_largest;
+  size_type m_k;
+  value_compare m_comp;
+
+  [[nodiscard]] bool fits_smallest(const T& t) const {
+    return m_smallest.size() < m_k ||
+           (m_k != 0 && m_comp(t, m_smallest.back()));
+  }
+
+  [[nodiscard]] bool fits_largest(const T& t) const {
+    return m_largest.size() < m_k ||
+           (m_k != 0 && m_comp(m_largest.front(), t));
+  }
+
+  template <typename U>
+  bool push_smallest(U&& u) {
+    if (!fits_smallest(u)) return false;
+    if (m_smallest.size() < m_k) {
+      m_smallest.push(std::forward<U>(u));
+    } else {
+      m_smallest.replace_back(std::forward<U>(u));
+    }
+    return true;
+  }
+
+  template <typename U>
+  bool push_largest(U&& u) {
+    if (!fits_largest(u)) return false;
+    if (m_largest.size() < m_k) {
+      m_largest.push(std::forward<U>(u));
+    } else {
+      m_largest.replace_front(std::forward<U>(u));
+    }
+    return true;
+  }
+};
+
+}  // namespace misc
@@ -5,9 +5,16 @@
 
 namespace misc {
 
-[[nodiscard]] auto fopen_ptr(const char* filename, const char* mode) {
-  return std::unique_ptr<FILE, decltype(&std::fclose)>{
-      std::fopen(filename, mode), &std::fclose};
+using file_ptr = std::unique_ptr<FILE, decltype(&std::fclose)>;
+
+[[nodiscard]] inline file_ptr fopen_ptr(const char* filename,
+                                        const char* mode) {
+  return file_ptr{std::fopen(filename, mode), &std::fclose};
+}
+
+/// @brief Opens a temporary file, which is removed when it's closed
+[[nodiscard]] inline file_ptr tmpfile_ptr() {
+  return file_ptr{std::tmpfile(), &std::fclose};
 }
 
 }  // namespace misc
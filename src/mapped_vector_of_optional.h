@@ -0,0 +1,289 @@
+#pragma once
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <cassert>
+#include <cerrno>
+#include <climits>
+#include <cstdint>
+#include <cstring>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <type_traits>
+#include <utility>
+
+#include "bit_scan.h"
+
+namespace misc {
+
+/// @brief A vector of optional elements that lives in a memory-mapped file.
+/// @tparam T The element type. It's stored as raw bytes, so it must be
+/// trivially copyable.
+/// @note The file holds a small header (magic, version, sizeof(T), capacity
+/// and size), then the occupancy words, then the elements: the same two
+/// arrays VectorOfOptional keeps in its allocated_storages. Opening a file
+/// maps it without reading it, so pages are only read when they're touched.
+/// Changes reach the file when the kernel writes the pages back, or when
+/// flush() is called. Errors from the OS are thrown as std::system_error.
+template <typename T>
+class mapped_vector_of_optional {
+  static_assert(std::is_trivially_copyable_v<T>);
+
+ protected:
+  using word_type = uint64_t;
+
+  static constexpr size_t WORD_BITS = sizeof(word_type) * CHAR_BIT;
+  // The file starts with "mvoopt\n\0" (written on a little-endian machine)
+  static constexpr uint64_t MAGIC = 0x000a74706f6f766d;
+  static constexpr uint32_t VERSION = 1;
+
+  struct header {
+    uint64_t magic;
+    uint32_t version;
+    uint32_t element_size;
+    uint64_t capacity;
+    uint64_t size;
+  };
+
+ public:
+  using value_type = T;
+  using size_type = size_t;
+
+  /// @brief Creates (or truncates) a file holding an empty vector
+  /// @param capacity The number of slots to make room for
+  [[nodiscard]] static mapped_vector_of_optional create(const std::string& path,
+                                                        size_t capacity = 0) {
+    mapped_vector_of_optional retval{
+        checked(::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644),
+                "open")};
+    retval.map(capacity);
+    *retval.get_header() = header{MAGIC, VERSION, sizeof(T), capacity, 0};
+    return retval;
+  }
+
+  /// @brief Maps a file written by create()
+  /// @throws std::system_error If the file can't be opened, or doesn't hold a
+  /// vector of this T
+  [[nodiscard]] static mapped_vector_of_optional open(const std::string& path) {
+    mapped_vector_of_optional retval{
+        checked(::open(path.c_str(), O_RDWR), "open")};
+    struct stat st {};
+    checked(::fstat(retval.m_fd, &st), "fstat");
+    header h{};
+    if (static_cast<size_t>(st.st_size) < sizeof(header) ||
+        ::pread(retval.m_fd, &h, sizeof(h), 0) !=
+            static_cast<ssize_t>(sizeof(h)) ||
+        h.magic != MAGIC || h.version != VERSION ||
+        h.element_size != sizeof(T) || h.size > h.capacity ||
+        static_cast<size_t>(st.st_size) < file_size(h.capacity)) {
+      throw std::system_error(std::make_error_code(std::errc::invalid_argument),
+                              "not a mapped_vector_of_optional of this type");
+    }
+    retval.map(h.capacity);
+    return retval;
+  }
+
+  mapped_vector_of_optional(mapped_vector_of_optional&& o) noexcept
+      : m_fd(std::exchange(o.m_fd, -1)),
+        m_mapping(std::exchange(o.m_mapping, nullptr)),
+        m_mapping_size(std::exchange(o.m_mapping_size, 0)) {}
+
+  mapped_vector_of_optional& operator=(mapped_vector_of_optional&& o) noexcept {
+    using std::swap;
+    swap(m_fd, o.m_fd);
+    swap(m_mapping, o.m_mapping);
+    swap(m_mapping_size, o.m_mapping_size);
+    return *this;
+  }
+
+  ~mapped_vector_of_optional() {
+    if (m_mapping != nullptr) ::munmap(m_mapping, m_mapping_size);
+    if (m_fd != -1) ::close(m_fd);
+  }
+
+  [[nodiscard]] size_t size() const { return get_header()->size; }
+
+  [[nodiscard]] size_t capacity() const { return get_header()->capacity; }
+
+  [[nodiscard]] T* operator[](size_t pos) {
+    return is_set(pos) ? data() + pos : nullptr;
+  }
+
+  [[nodiscard]] const T* operator[](size_t pos) const {
+    return const_cast<mapped_vector_of_optional*>(this)->operator[](pos);
+  }
+
+  T* push_back(const T& arg) { return emplace_back(arg); }
+
+  template <typename... Args>
+  T* emplace_back(Args&&... args) {
+    resize(size() + 1);
+    return emplace_at(size() - 1, std::forward<Args>(args)...);
+  }
+
+  /// @brief Constructs an element in a slot, replacing any element in it
+  /// @param pos The slot. It must be below size().
+  template <typename... Args>
+  T* emplace_at(size_t pos, Args&&... args) {
+    assert(pos < size());
+    auto* retval = new (data() + pos) T(std::forward<Args>(args)...);
+    words()[pos / WORD_BITS] |= bit_mask(pos);
+    return retval;
+  }
+
+  T* emplace_at(size_t pos, std::nullopt_t) {
+    reset(pos);
+    return nullptr;
+  }
+
+  void reset(size_t pos) { words()[pos / WORD_BITS] &= ~bit_mask(pos); }
+
+  /// @brief Changes the number of slots. Growing past the capacity grows the
+  /// file and remaps it, so it invalidates pointers to elements.
+  void resize(size_t s) {
+    const auto n = size();
+    if (s < n) {
+      // Keep the bits at or past size() clear
+      for (auto i = next_set(s); i != n; i = next_set(i + 1)) {
+        reset(i);
+      }
+    } else if (s > capacity()) {
+      reserve(std::max(s, 2 * capacity()));
+    }
+    get_header()->size = s;
+  }
+
+  /// @brief Grows the file to hold s slots, and remaps it. If that fails,
+  /// the vector is left as it was.
+  void reserve(size_t s) {
+    const auto old_capacity = capacity();
+    if (s <= old_capacity) return;
+    const auto old_offset = data_offset(old_capacity);
+    map(s);
+
+    // The words array grew, so the elements start further in
+    auto* bytes = static_cast<unsigned char*>(m_mapping);
+    std::memmove(bytes + data_offset(s), bytes + old_offset,
+                 old_capacity * sizeof(T));
+    std::fill(words() + word_count(old_capacity), words() + word_count(s),
+              word_type{0});
+    get_header()->capacity = s;
+  }
+
+  void clear() { resize(0); }
+
+  /// @brief The number of slots holding a value
+  [[nodiscard]] size_t count() const {
+    size_t retval = 0;
+    for (size_t w = 0; w < word_count(size()); ++w) {
+      retval += static_cast<size_t>(popcount(words()[w]));
+    }
+    return retval;
+  }
+
+  /// @brief The first slot at or after pos that holds a value
+  /// @return The slot's index, or size() if there is none
+  [[nodiscard]] size_t next_set(size_t pos) const {
+    const auto n = size();
+    if (pos >= n) return n;
+    auto w = pos / WORD_BITS;
+    auto bits = words()[w] & (~word_type{0} << (pos % WORD_BITS));
+    while (bits == 0) {
+      if (++w == word_count(n)) return n;
+      bits = words()[w];
+    }
+    return w * WORD_BITS + static_cast<size_t>(countr_zero(bits));
+  }
+
+  /// @brief Calls f(index, value) for each slot holding a value, in order
+  template <typename F>
+  void for_each_set(F&& f) {
+    for (auto i = next_set(0); i != size(); i = next_set(i + 1)) {
+      f(i, data()[i]);
+    }
+  }
+
+  template <typename F>
+  void for_each_set(F&& f) const {
+    for (auto i = next_set(0); i != size(); i = next_set(i + 1)) {
+      f(i, std::as_const(data()[i]));
+    }
+  }
+
+  /// @brief Writes the changed pages back to the file, and waits for them
+  void flush() {
+    checked(::msync(m_mapping, m_mapping_size, MS_SYNC), "msync");
+  }
+
+ protected:
+  int m_fd;
+  void* m_mapping = nullptr;
+  size_t m_mapping_size = 0;
+
+  explicit mapped_vector_of_optional(int fd) : m_fd(fd) {}
+
+  static int checked(int result, const char* what) {
+    if (result == -1) {
+      throw std::system_error(errno, std::generic_category(), what);
+    }
+    return result;
+  }
+
+  static constexpr size_t word_count(size_t bits) {
+    return (bits + WORD_BITS - 1) / WORD_BITS;
+  }
+
+  static constexpr word_type bit_mask(size_t i) {
+    return word_type{1} << (i % WORD_BITS);
+  }
+
+  static constexpr size_t data_offset(size_t capacity) {
+    constexpr auto align = alignof(T);
+    const auto words_end =
+        sizeof(header) + word_count(capacity) * sizeof(word_type);
+    return (words_end + align - 1) / align * align;
+  }
+
+  static constexpr size_t file_size(size_t capacity) {
+    return data_offset(capacity) + capacity * sizeof(T);
+  }
+
+  // Sizes the file for capacity slots, and maps all of it. A remap only grows
+  // the file, so the current mapping stays valid, and is only replaced once
+  // the new one succeeds.
+  void map(size_t capacity) {
+    const auto size = file_size(capacity);
+    checked(::ftruncate(m_fd, static_cast<off_t>(size)), "ftruncate");
+    auto* mapping =
+        ::mmap(nullptr, size, PROT_READ | PROT_WRITE, MAP_SHARED, m_fd, 0);
+    if (mapping == MAP_FAILED) {
+      throw std::system_error(errno, std::generic_category(), "mmap");
+    }
+    if (m_mapping != nullptr) ::munmap(m_mapping, m_mapping_size);
+    m_mapping = mapping;
+    m_mapping_size = size;
+  }
+
+  [[nodiscard]] header* get_header() const {
+    return static_cast<header*>(m_mapping);
+  }
+
+  [[nodiscard]] word_type* words() const {
+    return reinterpret_cast<word_type*>(get_header() + 1);
+  }
+
+  [[nodiscard]] T* data() const {
+    return reinterpret_cast<T*>(static_cast<unsigned char*>(m_mapping) +
+                                data_offset(capacity()));
+  }
+
+  [[nodiscard]] bool is_set(size_t pos) const {
+    return words()[pos / WORD_BITS] & bit_mask(pos);
+  }
+};
+
+}  // namespace misc
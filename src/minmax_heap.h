@@ -1,20 +1,125 @@
 #pragma once
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <iterator>
+#include <thread>
 #include <type_traits>
 #include <vector>
 
 #include "log2.h"
+#include "parallel_for.h"
 
 namespace misc {
+/// @brief The classic implicit layout of a binary heap. Node i (1-based) is
+/// stored at position i - 1.
+struct implicit_layout {
+  static constexpr bool is_implicit = true;
+
+  [[nodiscard]] static constexpr size_t position(size_t i) {
+    assert(i > 0);
+    return i - 1;
+  }
+
+  /// @brief The position of the left (b = 0) or right (b = 1) child of the
+  /// node at pos
+  [[nodiscard]] static constexpr size_t child_position(size_t pos, size_t b) {
+    return 2 * pos + 1 + b;
+  }
+
+  /// @brief The position of the parent of the node at pos
+  [[nodiscard]] static constexpr size_t parent_position(size_t pos) {
+    assert(pos > 0);
+    return (pos - 1) / 2;
+  }
+
+  [[nodiscard]] static constexpr size_t storage_size(size_t n) { return n; }
+};
+
+/// @brief A blocked (B-heap style) layout. The tree is cut into subtrees of
+/// Height levels, and each subtree is stored contiguously. Walking down the
+/// tree then only leaves a block every Height levels, instead of on (nearly)
+/// every level once the heap is larger than the cache.
+/// @tparam Height The number of tree levels stored in each block. A block
+/// holds 2^Height - 1 nodes in 2^Height slots. e.g. 3 fits 8 byte elements
+/// into a 64 byte cache line, 9 fits them into a 4KiB page.
+/// @note The first slot of each block is left unused, so that a node's slot
+/// in its block is its 1-based index in the block's subtree. Children and
+/// parents are then found from a position with a few shifts, and the heap
+/// walks the tree without going back to the node index. The unused slots, and
+/// those of the partially filled last layer of blocks, are default
+/// constructed, so the element type must be default constructible. While the
+/// last layer is shallow, most of its slots are unused, so a large Height can
+/// take several times the memory of the implicit layout.
+template <size_t Height>
+struct blocked_layout {
+  static_assert(Height > 0);
+  static constexpr bool is_implicit = false;
+  static constexpr size_t block_slots = size_t{1} << Height;
+
+  [[nodiscard]] static size_t position(size_t i) {
+    assert(i > 0);
+    const auto depth = static_cast<size_t>(log2(i));
+    const auto block_depth = depth / Height * Height;
+    const auto local_depth = depth - block_depth;
+    const auto block_root = i >> local_depth;
+    const auto first_block_root = size_t{1} << block_depth;
+    const auto local_mask = (size_t{1} << local_depth) - 1;
+    const auto local_ind = (local_mask + 1) | (i & local_mask);
+    // All the blocks above this layer are full, and the blocks form a tree
+    // with block_slots children per block
+    const auto blocks_above = (first_block_root - 1) / (block_slots - 1);
+    const auto block = blocks_above + (block_root - first_block_root);
+    return block * block_slots + local_ind;
+  }
+
+  [[nodiscard]] static constexpr size_t child_position(size_t pos, size_t b) {
+    const auto local = pos % block_slots;
+    if (local < block_slots / 2) return pos + local + b;
+    // The node is on the block's last level, so its children are the roots
+    // of two of the block's child blocks
+    const auto block = pos / block_slots;
+    const auto child_block =
+        block * block_slots + 1 + 2 * (local - block_slots / 2) + b;
+    return child_block * block_slots + 1;
+  }
+
+  [[nodiscard]] static constexpr size_t parent_position(size_t pos) {
+    const auto local = pos % block_slots;
+    if (local > 1) return pos - local + local / 2;
+    // The node is a block's root, so its parent is on the last level of the
+    // parent block
+    const auto block = pos / block_slots;
+    assert(block > 0);
+    const auto parent_block = (block - 1) / block_slots;
+    const auto child_ind = (block - 1) % block_slots;
+    return parent_block * block_slots + block_slots / 2 + child_ind / 2;
+  }
+
+  [[nodiscard]] static size_t storage_size(size_t n) {
+    if (n == 0) return 0;
+    // Every level above the last is full, so the last slot used is either the
+    // last node, or the last node of the level above it (which lives in the
+    // last block of the layer).
+    const auto depth = static_cast<size_t>(log2(n));
+    auto last = position(n);
+    if (depth > 0) {
+      last = std::max(last, position((size_t{1} << depth) - 1));
+    }
+    return last + 1;
+  }
+};
+
 /// @brief A min-max heap
 /// @tparam T The element type
 /// @tparam Comp The comparison operator
+/// @tparam Layout Maps heap nodes to positions in the underlying container.
+/// See implicit_layout and blocked_layout.
 /// @note This code is based on the paper, "Min-Max Heaps and Generalized
 /// Priority Queues" by M.D.ATKINSON, J.- R.SACK, N.SANTORO, and T.STROTHOTTE,
 /// and the wikipedia article at https://en.wikipedia.org/wiki/Min-max_heap
-template <typename T, typename Comp = std::less<T>>
+template <typename T, typename Comp = std::less<T>,
+          typename Layout = implicit_layout>
 class minmax_heap {
  public:
   using container_type = std::vector<T>;
@@ -23,6 +128,7 @@ class minmax_heap {
   using size_type = typename container_type::size_type;
   using reference = typename container_type::reference;
   using const_reference = typename container_type::const_reference;
+  using layout_type = Layout;
 
   minmax_heap(const value_compare& comp = value_compare{}) noexcept(
       std::is_nothrow_constructible_v<minmax_heap, container_type,
@@ -32,71 +138,162 @@ class minmax_heap {
   minmax_heap(
       container_type container,
       const value_compare& comp =
-          value_compare{}) noexcept(std::
+          value_compare{}) noexcept(Layout::is_implicit&& std::
                                         is_nothrow_move_constructible_v<
                                             container_type>&& std::
                                             is_nothrow_copy_constructible_v<
                                                 value_compare>)
-      : m_heap(std::move(container)), m_comp(comp) {
+      : m_comp(comp) {
+    assign_sequence(std::move(container));
     init_sequence();
   }
 
+  /// @brief Requests that the heap is built by several threads
+  struct parallel_t {
+    size_t num_threads = std::thread::hardware_concurrency();
+  };
+
+  /// @brief Builds the heap with several threads. Independent subtrees are
+  /// built concurrently, then the levels above them are finished serially.
+  minmax_heap(parallel_t parallel, container_type container,
+              const value_compare& comp = value_compare{})
+      : m_comp(comp) {
+    assign_sequence(std::move(container));
+    init_sequence(parallel);
+  }
+
   minmax_heap(const minmax_heap&) = default;
   minmax_heap(minmax_heap&&) = default;
   minmax_heap& operator=(const minmax_heap&) = default;
   minmax_heap& operator=(minmax_heap&&) = default;
 
-  [[nodiscard]] bool empty() const { return m_heap.empty(); }
+  [[nodiscard]] bool empty() const { return m_size == 0; }
 
-  [[nodiscard]] size_type size() const { return m_heap.size(); }
+  [[nodiscard]] size_type size() const { return m_size; }
 
   [[nodiscard]] const_reference front() const {
     assert(!empty());
-    return m_heap.front();
+    return elem(1);
   }
 
   [[nodiscard]] const_reference back() const {
     assert(!empty());
-    if (m_heap.size() < 2) return front();
-    return (m_heap.size() == 2 || m_comp(m_heap[2], m_heap[1])) ? m_heap[1]
-                                                                : m_heap[2];
+    return elem(back_node());
   }
 
   void push(const T& t) {
-    m_heap.emplace_back(t);
+    append(t);
     push();
   }
 
   void push(T&& t) {
-    m_heap.emplace_back(std::move(t));
+    append(std::move(t));
     push();
   }
 
-  void pop_front() {
-    m_heap.front() = std::move(m_heap.back());
-    m_heap.pop_back();
-    push_down(1);
+  /// @brief Pushes the elements in [first, last). Only the ancestors of the
+  /// new elements are reordered, unless there are at least as many new
+  /// elements as old, when the whole heap is rebuilt.
+  template <typename Iter>
+  void push_range(Iter first, Iter last) {
+    using category = typename std::iterator_traits<Iter>::iterator_category;
+    if constexpr (Layout::is_implicit &&
+                  std::is_base_of_v<std::forward_iterator_tag, category>) {
+      m_heap.reserve(size() +
+                     static_cast<size_type>(std::distance(first, last)));
+    }
+
+    const auto old_size = size();
+    for (; first != last; ++first) {
+      append(*first);
+    }
+    if (size() - old_size >= old_size) {
+      init_sequence();
+    } else if (size() != old_size) {
+      init_sequence_from(old_size + 1);
+    }
   }
 
-  void pop_back() {
-    if (m_heap.size() < 3) {
-      m_heap.pop_back();
-      return;
+  /// @brief Moves the elements of another heap into this one
+  /// @note The heaps' comparators are assumed to be equivalent
+  void merge(minmax_heap&& o) {
+    if (o.size() > size()) {
+      using std::swap;
+      swap(m_heap, o.m_heap);
+      swap(m_size, o.m_size);
     }
-    const index_type max_ind = m_comp(m_heap[1], m_heap[2]) ? 3 : 2;
-    m_heap[max_ind - 1] = std::move(m_heap.back());
-    m_heap.pop_back();
-    push_down(max_ind);
+    auto seq = o.extract_sequence();
+    push_range(std::make_move_iterator(seq.begin()),
+               std::make_move_iterator(seq.end()));
+  }
+
+  void pop_front() { pop_at(at(1)); }
+
+  void pop_back() { pop_at(back_node()); }
+
+  /// @brief Removes and returns the first element
+  [[nodiscard]] value_type pop_front_value() {
+    assert(!empty());
+    const auto root = at(1);
+    value_type retval = std::move(elem(root));
+    pop_at(root);
+    return retval;
+  }
+
+  /// @brief Removes and returns the last element
+  [[nodiscard]] value_type pop_back_value() {
+    assert(!empty());
+    const auto max = back_node();
+    value_type retval = std::move(elem(max));
+    pop_at(max);
+    return retval;
+  }
+
+  /// @brief Replaces the first element. Equivalent to pop_front() followed by
+  /// push(t), but only sifts once.
+  void replace_front(const T& t) { replace_front(T(t)); }
+
+  void replace_front(T&& t) {
+    assert(!empty());
+    elem(1) = std::move(t);
+    push_down(1);
+  }
+
+  /// @brief Replaces the last element. Equivalent to pop_back() followed by
+  /// push(t), but only sifts once.
+  void replace_back(const T& t) { replace_back(T(t)); }
+
+  void replace_back(T&& t) {
+    assert(!empty());
+    const auto max = back_node();
+    elem(max) = std::move(t);
+    // The new element may belong at the front
+    fix(max);
   }
 
   [[nodiscard]] value_compare value_comp() const { return m_comp; }
 
+  /// @brief Removes the elements from the heap.
+  /// @return The elements, in the implicit (min-max heap ordered) layout,
+  /// whatever the Layout of this heap.
   container_type extract_sequence() {
-    return container_type{std::move(m_heap)};
+    if constexpr (Layout::is_implicit) {
+      m_size = 0;
+      return container_type{std::move(m_heap)};
+    } else {
+      container_type seq;
+      seq.reserve(size());
+      for (index_type i = 1; i <= size(); ++i) {
+        seq.push_back(std::move(elem(i)));
+      }
+      m_heap.clear();
+      m_size = 0;
+      return seq;
+    }
   }
 
   void adopt_sequence(container_type&& seq) {
-    m_heap = std::move(seq);
+    assign_sequence(std::move(seq));
     init_sequence();
   }
 
@@ -104,10 +301,17 @@ class minmax_heap {
     adopt_sequence(container_type{seq});
   }
 
+  void adopt_sequence(parallel_t parallel, container_type&& seq) {
+    assign_sequence(std::move(seq));
+    init_sequence(parallel);
+  }
+
   struct minmax_heap_range_t {};
 
+  /// @brief Adopts a sequence that is already a min-max heap (in the
+  /// implicit layout, see is_minmax_heap)
   void adopt_sequence(minmax_heap_range_t, container_type&& seq) {
-    m_heap = std::move(seq);
+    assign_sequence(std::move(seq));
   }
 
   void adopt_sequence(minmax_heap_range_t, const container_type& seq) {
@@ -118,73 +322,293 @@ class minmax_heap {
   using index_type = size_type;  // 1-based
   using level_type = size_type;  // 0-based
   container_type m_heap;
+  size_type m_size = 0;
   value_compare m_comp;
 
   [[nodiscard]] auto inv_comp() const {
     return [&](const auto& l, const auto& r) { return m_comp(r, l); };
   }
 
+  // A node's index, and its position in the container. The walks up and
+  // down the heap carry both, so they step along the layout's child and
+  // parent positions instead of mapping every index they visit.
+  struct node_ref {
+    index_type i;
+    size_type pos;
+  };
+
+  [[nodiscard]] static node_ref at(index_type i) {
+    return {i, Layout::position(i)};
+  }
+
+  [[nodiscard]] static node_ref child(node_ref n, size_type b) {
+    return {2 * n.i + b, Layout::child_position(n.pos, b)};
+  }
+
+  [[nodiscard]] static node_ref parent(node_ref n) {
+    assert(n.i > 1);
+    return {n.i / 2, Layout::parent_position(n.pos)};
+  }
+
+  [[nodiscard]] node_ref back_node() const {
+    const auto root = at(1);
+    if (size() < 2) return root;
+    const auto left = child(root, 0);
+    const auto right = child(root, 1);
+    return (size() == 2 || m_comp(elem(right), elem(left))) ? left : right;
+  }
+
+  [[nodiscard]] reference elem(index_type i) {
+    return m_heap[Layout::position(i)];
+  }
+
+  [[nodiscard]] const_reference elem(index_type i) const {
+    return m_heap[Layout::position(i)];
+  }
+
+  [[nodiscard]] reference elem(node_ref n) { return m_heap[n.pos]; }
+
+  [[nodiscard]] const_reference elem(node_ref n) const { return m_heap[n.pos]; }
+
+  // Removes the element at n, the front or the back, by moving the last
+  // element into its place and sinking it. The node is passed in, rather than
+  // found again, because its element may already have been moved out.
+  void pop_at(node_ref n) {
+    assert(!empty() && n.i <= 3);
+    const auto last = size();
+    if (n.i != last) elem(n) = std::move(elem(last));
+    remove_last();
+    if (n.i < last) push_down(n);
+  }
+
+  template <typename U>
+  void append(U&& u) {
+    if constexpr (Layout::is_implicit) {
+      m_heap.emplace_back(std::forward<U>(u));
+    } else {
+      // The container only grows, so every other node is already in it.
+      // Growing geometrically keeps pushes amortized O(1) copies, like the
+      // implicit layout's push_back.
+      const auto pos = Layout::position(size() + 1);
+      if (pos >= m_heap.size()) {
+        m_heap.resize(std::max(pos + 1, 2 * m_heap.size()));
+      }
+      m_heap[pos] = std::forward<U>(u);
+    }
+    ++m_size;
+  }
+
+  void remove_last() {
+    assert(!empty());
+    if constexpr (Layout::is_implicit) {
+      m_heap.pop_back();
+    } else if constexpr (!std::is_trivially_destructible_v<T>) {
+      // The slot stays in the container, so release what the element holds
+      elem(size()) = T();
+    }
+    --m_size;
+  }
+
+  void assign_sequence(container_type&& seq) {
+    m_size = seq.size();
+    if constexpr (Layout::is_implicit) {
+      m_heap = std::move(seq);
+    } else {
+      m_heap.clear();
+      m_heap.resize(Layout::storage_size(m_size));
+      for (index_type i = 1; i <= m_size; ++i) {
+        elem(i) = std::move(seq[i - 1]);
+      }
+    }
+  }
+
   void init_sequence() {
-    if (m_heap.size() < 2) {
+    if (size() < 2) {
       return;
     }
-    for (index_type i = m_heap.size() / 2; i > 0; --i) {
+    for (index_type i = size() / 2; i > 0; --i) {
       push_down(i);
     }
   }
 
-  void push_down(index_type m) {
-    assert(m > 0);
+  /// @brief Restores the heap after the element at i has been changed to an
+  /// arbitrary value.
+  void fix(index_type i) { fix(at(i)); }
+
+  void fix(node_ref n) {
+    if (is_on_min_level(n.i)) {
+      fix(n, m_comp, inv_comp());
+    } else {
+      fix(n, inv_comp(), m_comp);
+    }
+  }
+
+  template <typename CompFunc, typename InvCompFunc>
+  void fix(node_ref n, const CompFunc& comp, const InvCompFunc& inv_comp) {
+    using std::swap;
+    if (n.i > 1) {
+      const auto p = parent(n);
+      if (comp(elem(p), elem(n))) {
+        // It belongs on the parent's levels. The parent's element bounds
+        // everything below it, so it can take this position and sink.
+        swap(elem(p), elem(n));
+        push(p, inv_comp);
+        push_down(n);
+        return;
+      }
+      if (has_grandparent(n.i) && comp(elem(n), elem(parent(p)))) {
+        push(n, comp);
+        return;
+      }
+    }
+    push_down(n);
+  }
+
+  /// @brief Removes the element at i
+  void erase_at(index_type i) {
+    assert(i > 0 && i <= size());
+    const auto n = at(i);
+    const auto last = size();
+    if (i != last) elem(n) = std::move(elem(last));
+    remove_last();
+    if (i != last) fix(n);
+  }
+
+  // Below this size, starting threads costs more than they save
+  static constexpr size_type parallel_init_threshold = size_type{1} << 16;
+
+  void init_sequence(parallel_t parallel) {
+    if (parallel.num_threads < 2 || size() < parallel_init_threshold) {
+      init_sequence();
+      return;
+    }
+
+    // The subtrees rooted on one level are independent. Pick a level with a
+    // few subtrees per thread, so uneven subtrees balance out.
+    const auto last_parent = size() / 2;
+    auto level = static_cast<size_type>(log2(4 * parallel.num_threads));
+    level = std::min(level, static_cast<size_type>(log2(last_parent)));
+    const index_type first_root = index_type{1} << level;
+
+    parallel_for(first_root, parallel.num_threads,
+                 [&](size_t first, size_t last) {
+                   for (auto i = first; i < last; ++i) {
+                     init_subtree(first_root + i);
+                   }
+                 });
+
+    for (index_type i = first_root - 1; i > 0; --i) {
+      push_down(i);
+    }
+  }
+
+  /// @brief Like init_sequence, but only for the subtree rooted at root
+  void init_subtree(index_type root) {
+    const auto last_parent = size() / 2;
+    size_type depth = 0;
+    while ((root << (depth + 1)) <= last_parent) {
+      ++depth;
+    }
+    for (auto d = depth + 1; d-- > 0;) {
+      const auto first = root << d;
+      const auto last = std::min(first + (index_type{1} << d) - 1, last_parent);
+      for (auto i = last; i >= first; --i) {
+        push_down(i);
+      }
+    }
+  }
+
+  /// @brief Restores the heap after elements were appended, starting at
+  /// first_new. Like init_sequence, but only sinks the new elements'
+  /// ancestors.
+  void init_sequence_from(index_type first_new) {
+    assert(first_new > 1 && first_new <= size());
+    index_type lo = first_new / 2;
+    index_type hi = size() / 2;
+    while (true) {
+      for (index_type i = hi; i >= lo; --i) {
+        push_down(i);
+      }
+      if (lo == 1) return;
+      // Skip the ancestors already in [lo, hi]
+      hi = std::min(hi / 2, lo - 1);
+      lo /= 2;
+    }
+  }
+
+  void push_down(index_type m) { push_down(at(m)); }
 
-    while (has_children(m)) {
-      index_type i = m;
-      if (is_on_min_level(i)) {
-        m = push_down(i, m_comp);
-      } else {
-        m = push_down(i, inv_comp());
+  void push_down(node_ref m) {
+    assert(m.i > 0);
+
+    // Each step moves to a grandchild, which is on the same kind of level, so
+    // the level only needs checking once.
+    if (is_on_min_level(m.i)) {
+      while (has_children(m.i)) {
+        m = push_down(m, m_comp);
+      }
+    } else {
+      while (has_children(m.i)) {
+        m = push_down(m, inv_comp());
       }
     }
   }
 
   template <typename CompFunc>
-  index_type push_down(index_type i, const CompFunc& comp) {
+  node_ref push_down(node_ref n, const CompFunc& comp) {
     using std::swap;
-    const auto m = min_child_or_grandchild(i, comp);
-    if (comp(m_heap[m - 1], m_heap[i - 1])) {
-      swap(m_heap[m - 1], m_heap[i - 1]);
-      if (is_grandchild(i, m)) {
+    const auto m = min_child_or_grandchild(n, comp);
+    if (comp(elem(m), elem(n))) {
+      swap(elem(m), elem(n));
+      if (is_grandchild(n.i, m.i)) {
         const auto p = parent(m);
-        if (comp(m_heap[p - 1], m_heap[m - 1])) {
-          swap(m_heap[p - 1], m_heap[m - 1]);
+        if (comp(elem(p), elem(m))) {
+          swap(elem(p), elem(m));
         }
         return m;
       }
     }
-    return m_heap.size();  // return an index we know has no children
+    return {size(), 0};  // return a node we know has no children
   }
 
   template <typename CompFunc>
-  index_type min_child_or_grandchild(index_type m, const CompFunc& comp) const {
-    assert(has_children(m));
-    const index_type left_child_ind = 2 * m;
-    const index_type right_child_ind = 2 * m + 1;
-    const index_type left_left_grandchild = 2 * left_child_ind;
-    const index_type right_left_grandchild = 2 * left_child_ind + 1;
-    const index_type left_right_grandchild = 2 * right_child_ind;
-    const index_type right_right_grandchild = 2 * right_child_ind + 1;
-
-    const auto* min_val = &m_heap[left_child_ind - 1];
-    index_type retval = left_child_ind;
-
-    for (index_type i :
-         {right_child_ind, left_left_grandchild, right_left_grandchild,
+  node_ref min_child_or_grandchild(node_ref m, const CompFunc& comp) const {
+    assert(has_children(m.i));
+    const auto left_child = child(m, 0);
+    const auto right_child = child(m, 1);
+    const auto left_left_grandchild = child(left_child, 0);
+    const auto right_left_grandchild = child(left_child, 1);
+    const auto left_right_grandchild = child(right_child, 0);
+    const auto right_right_grandchild = child(right_child, 1);
+
+    if (size() >= right_right_grandchild.i) {
+      // Each child bounds its own children, so with all four grandchildren
+      // present one of them is the minimum. A tournament finds it with three
+      // comparisons, whose results only select nodes (so they can compile
+      // to conditional moves rather than branches).
+      const auto left_min =
+          comp(elem(right_left_grandchild), elem(left_left_grandchild))
+              ? right_left_grandchild
+              : left_left_grandchild;
+      const auto right_min =
+          comp(elem(right_right_grandchild), elem(left_right_grandchild))
+              ? right_right_grandchild
+              : left_right_grandchild;
+      return comp(elem(right_min), elem(left_min)) ? right_min : left_min;
+    }
+
+    const auto* min_val = &elem(left_child);
+    auto retval = left_child;
+
+    for (const auto& n :
+         {right_child, left_left_grandchild, right_left_grandchild,
           left_right_grandchild, right_right_grandchild}) {
-      if (m_heap.size() < i) {
+      if (size() < n.i) {
         return retval;
       }
-      if (comp(m_heap[i - 1], *min_val)) {
-        min_val = &m_heap[i - 1];
-        retval = i;
+      if (comp(elem(n), *min_val)) {
+        min_val = &elem(n);
+        retval = n;
       }
     }
     return retval;
@@ -203,7 +627,7 @@ class minmax_heap {
 
   [[nodiscard]] bool has_children(index_type m) const {
     assert(m > 0);
-    return 2 * m <= m_heap.size();
+    return 2 * m <= size();
   }
 
   [[nodiscard]] bool is_on_min_level(index_type m) const {
@@ -211,48 +635,43 @@ class minmax_heap {
     return (log2(m) & 0b1) == 0;
   }
 
-  [[nodiscard]] index_type parent(index_type m) const {
-    assert(m > 1);
-    return m / 2;
-  }
-
-  [[nodiscard]] index_type grandparent(index_type m) const {
-    assert(m > 2);
-    return m / 4;
-  }
-
   void push() {
-    const auto i = m_heap.size();
-    if (i == 1) return;
+    const auto n = at(size());
+    if (n.i == 1) return;
 
-    if (is_on_min_level(i)) {
-      push(i, m_comp, inv_comp());
+    if (is_on_min_level(n.i)) {
+      push(n, m_comp, inv_comp());
     } else {
-      push(i, inv_comp(), m_comp);
+      push(n, inv_comp(), m_comp);
     }
   }
 
   template <typename CompFunc, typename InvCompFunc>
-  void push(index_type i, const CompFunc& comp, const InvCompFunc& inv_comp) {
+  void push(node_ref n, const CompFunc& comp, const InvCompFunc& inv_comp) {
     using std::swap;
-    const auto p = parent(i);
-    if (comp(m_heap[p - 1], m_heap[i - 1])) {
-      swap(m_heap[p - 1], m_heap[i - 1]);
+    const auto p = parent(n);
+    if (comp(elem(p), elem(n))) {
+      swap(elem(p), elem(n));
       push(p, inv_comp);
     } else {
-      push(i, comp);
+      push(n, comp);
     }
   }
 
   template <typename CompFunc>
   void push(index_type i, const CompFunc& comp) {
+    push(at(i), comp);
+  }
+
+  template <typename CompFunc>
+  void push(node_ref n, const CompFunc& comp) {
     using std::swap;
     while (true) {
-      if (!has_grandparent(i)) return;
-      const auto gp = grandparent(i);
-      if (!comp(m_heap[i - 1], m_heap[gp - 1])) return;
-      swap(m_heap[i - 1], m_heap[gp - 1]);
-      i = gp;
+      if (!has_grandparent(n.i)) return;
+      const auto gp = parent(parent(n));
+      if (!comp(elem(n), elem(gp))) return;
+      swap(elem(n), elem(gp));
+      n = gp;
     }
   }
 };
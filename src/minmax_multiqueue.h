@@ -0,0 +1,152 @@
+#pragma once
+#include <atomic>
+#include <cassert>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <optional>
+#include <random>
+#include <thread>
+#include <utility>
+
+#include "minmax_heap.h"
+
+namespace misc {
+
+/// @brief A concurrent, relaxed, double-ended priority queue.
+/// @tparam T The element type
+/// @tparam Comp The comparison operator
+/// @tparam Mutex The mutex guarding each internal heap
+/// @note Elements are spread over several internally locked minmax_heaps. A
+/// push goes to a random heap. A pop samples two random heaps and takes the
+/// better of their fronts (or backs). Threads rarely contend for the same
+/// heap, so throughput scales with threads, at the cost of the popped element
+/// only being close to the min (or max). The rank error is O(number of
+/// heaps) in expectation. This is the MultiQueue design of Rihani, Sanders
+/// and Dementiev, "MultiQueues: Simpler, Faster, and Better Relaxed
+/// Concurrent Priority Queues", extended to both ends.
+template <typename T, typename Comp = std::less<T>,
+          typename Mutex = std::mutex>
+class minmax_multiqueue {
+ public:
+  using heap_type = minmax_heap<T, Comp>;
+  using value_type = T;
+  using value_compare = Comp;
+  using size_type = typename heap_type::size_type;
+
+  /// @param num_heaps The number of internal heaps. A small multiple of the
+  /// number of threads using the queue works well.
+  explicit minmax_multiqueue(
+      size_t num_heaps = 2 * std::max(std::thread::hardware_concurrency(), 1u),
+      const value_compare& comp = value_compare{})
+      : m_heaps(std::make_unique<locked_heap[]>(num_heaps)),
+        m_num_heaps(num_heaps),
+        m_comp(comp) {
+    assert(num_heaps > 0);
+    for (size_t i = 0; i < m_num_heaps; ++i) {
+      m_heaps[i].heap = heap_type{comp};
+    }
+  }
+
+  minmax_multiqueue(const minmax_multiqueue&) = delete;
+  minmax_multiqueue& operator=(const minmax_multiqueue&) = delete;
+
+  /// @brief The number of elements. Only exact when no other thread is using
+  /// the queue.
+  [[nodiscard]] size_type size() const {
+    return m_size.load(std::memory_order_relaxed);
+  }
+
+  [[nodiscard]] bool empty() const { return size() == 0; }
+
+  void push(const T& t) { push(T(t)); }
+
+  void push(T&& t) {
+    while (true) {
+      auto& locked = m_heaps[random_index()];
+      std::unique_lock lock(locked.mutex, std::try_to_lock);
+      if (lock.owns_lock()) {
+        locked.heap.push(std::move(t));
+        m_size.fetch_add(1, std::memory_order_relaxed);
+        return;
+      }
+    }
+  }
+
+  /// @brief Removes an element close to the min
+  /// @return The element, or nullopt if every heap was found empty
+  [[nodiscard]] std::optional<T> try_pop_min() {
+    return try_pop(
+        [&](const heap_type& a, const heap_type& b) {
+          return m_comp(b.front(), a.front());
+        },
+        [](heap_type& heap) { return heap.pop_front_value(); });
+  }
+
+  /// @brief Removes an element close to the max
+  /// @return The element, or nullopt if every heap was found empty
+  [[nodiscard]] std::optional<T> try_pop_max() {
+    return try_pop(
+        [&](const heap_type& a, const heap_type& b) {
+          return m_comp(a.back(), b.back());
+        },
+        [](heap_type& heap) { return heap.pop_back_value(); });
+  }
+
+ protected:
+  // Keep each heap on its own cache line(s)
+  struct alignas(64) locked_heap {
+    Mutex mutex;
+    heap_type heap;
+  };
+
+  std::unique_ptr<locked_heap[]> m_heaps;
+  size_t m_num_heaps;
+  value_compare m_comp;
+  std::atomic<size_type> m_size{0};
+
+  [[nodiscard]] size_t random_index() const {
+    thread_local std::minstd_rand rng{std::random_device{}()};
+    return std::uniform_int_distribution<size_t>{0, m_num_heaps - 1}(rng);
+  }
+
+  // prefer_second(a, b) is true if b's element should be popped before a's
+  template <typename PreferSecond, typename Pop>
+  std::optional<T> try_pop(const PreferSecond& prefer_second, const Pop& pop) {
+    if (m_num_heaps > 1) {
+      while (true) {
+        const auto i = random_index();
+        auto j = random_index();
+        if (i == j) continue;
+
+        std::unique_lock lock_i(m_heaps[i].mutex, std::defer_lock);
+        std::unique_lock lock_j(m_heaps[j].mutex, std::defer_lock);
+        if (std::try_lock(lock_i, lock_j) != -1) continue;
+
+        auto* heap = &m_heaps[i].heap;
+        auto& other = m_heaps[j].heap;
+        if (heap->empty() || (!other.empty() && prefer_second(*heap, other))) {
+          heap = &other;
+        }
+        if (heap->empty()) break;
+
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return pop(*heap);
+      }
+    }
+
+    // Both samples were empty. Look through every heap before giving up.
+    const auto start = random_index();
+    for (size_t n = 0; n < m_num_heaps; ++n) {
+      auto& locked = m_heaps[(start + n) % m_num_heaps];
+      std::unique_lock lock(locked.mutex);
+      if (!locked.heap.empty()) {
+        m_size.fetch_sub(1, std::memory_order_relaxed);
+        return pop(locked.heap);
+      }
+    }
+    return std::nullopt;
+  }
+};
+
+}  // namespace misc
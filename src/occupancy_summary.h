@@ -0,0 +1,147 @@
+#pragma once
+#include <algorithm>
+#include <climits>
+#include <cstdint>
+#include <vector>
+
+#include "allocated_storages.h"
+#include "bit_scan.h"
+
+namespace misc {
+
+/// @brief Occupancy summary policy for VectorOfOptional that keeps no
+/// summary. Searches scan the occupancy words one by one.
+struct flat_occupancy {
+  using word_type = uint64_t;
+
+  void assign(arr_range<word_type>) {}
+  void refresh(arr_range<word_type>, size_t, size_t) {}
+  void word_set(size_t) {}
+  void word_cleared(arr_range<word_type>, size_t) {}
+
+  /// @brief The first non-empty word in [w, n_words), or n_words
+  [[nodiscard]] size_t next_word(arr_range<word_type> words, size_t w,
+                                 size_t n_words) const {
+    while (w < n_words && words[w] == 0) ++w;
+    return w < n_words ? w : n_words;
+  }
+
+  /// @brief The last non-empty word before w, or w if there is none
+  [[nodiscard]] size_t prev_word(arr_range<word_type> words, size_t w) const {
+    for (auto i = w; i > 0; --i) {
+      if (words[i - 1] != 0) return i - 1;
+    }
+    return w;
+  }
+};
+
+/// @brief Occupancy summary policy for VectorOfOptional that keeps two more
+/// bitmap levels: one bit per non-empty occupancy word, and one bit per
+/// non-empty word of that.
+/// @note Searches skip 4096 empty words (262144 slots) per top-level word, so
+/// scanning a very sparse vector costs about the number of set slots, not its
+/// capacity. Setting and clearing a slot updates the summary in O(1).
+class summarized_occupancy {
+ public:
+  using word_type = uint64_t;
+
+  /// @brief Rebuilds the summary for new occupancy words
+  void assign(arr_range<word_type> words) {
+    m_level1.assign(word_count(words.size()), 0);
+    m_level2.assign(word_count(m_level1.size()), 0);
+    refresh(words, 0, words.size());
+  }
+
+  /// @brief Recomputes the summary of words [first, last), after they were
+  /// changed in bulk
+  void refresh(arr_range<word_type> words, size_t first, size_t last) {
+    for (auto w = first; w < last; ++w) {
+      if (words[w] != 0) {
+        word_set(w);
+      } else {
+        word_cleared(words, w);
+      }
+    }
+  }
+
+  /// @brief Records that word w is not empty
+  void word_set(size_t w) {
+    m_level1[w / WORD_BITS] |= bit_mask(w);
+    m_level2[w / WORD_BITS / WORD_BITS] |= bit_mask(w / WORD_BITS);
+  }
+
+  /// @brief Records that word w may have become empty
+  void word_cleared(arr_range<word_type> words, size_t w) {
+    if (words[w] != 0) return;
+    auto& l1 = m_level1[w / WORD_BITS];
+    l1 &= ~bit_mask(w);
+    if (l1 == 0) {
+      m_level2[w / WORD_BITS / WORD_BITS] &= ~bit_mask(w / WORD_BITS);
+    }
+  }
+
+  [[nodiscard]] size_t next_word(arr_range<word_type>, size_t w,
+                                 size_t n_words) const {
+    if (w >= n_words) return n_words;
+    auto i1 = w / WORD_BITS;
+    if (const auto bits = m_level1[i1] & (~word_type{0} << (w % WORD_BITS))) {
+      return std::min(i1 * WORD_BITS + ctz(bits), n_words);
+    }
+    // Find the next non-empty level 1 word through level 2
+    ++i1;
+    auto i2 = i1 / WORD_BITS;
+    if (i2 >= m_level2.size()) return n_words;
+    auto bits = m_level2[i2] & (~word_type{0} << (i1 % WORD_BITS));
+    while (bits == 0) {
+      if (++i2 == m_level2.size()) return n_words;
+      bits = m_level2[i2];
+    }
+    i1 = i2 * WORD_BITS + ctz(bits);
+    return std::min(i1 * WORD_BITS + ctz(m_level1[i1]), n_words);
+  }
+
+  [[nodiscard]] size_t prev_word(arr_range<word_type>, size_t w) const {
+    if (w == 0) return w;
+    const auto last = w - 1;
+    auto i1 = last / WORD_BITS;
+    if (const auto bits = m_level1[i1] & below_or_at(last)) {
+      return i1 * WORD_BITS + clz_index(bits);
+    }
+    if (i1 == 0) return w;
+    --i1;
+    auto i2 = i1 / WORD_BITS;
+    auto bits = m_level2[i2] & below_or_at(i1);
+    while (bits == 0) {
+      if (i2-- == 0) return w;
+      bits = m_level2[i2];
+    }
+    i1 = i2 * WORD_BITS + clz_index(bits);
+    return i1 * WORD_BITS + clz_index(m_level1[i1]);
+  }
+
+ protected:
+  static constexpr size_t WORD_BITS = sizeof(word_type) * CHAR_BIT;
+
+  std::vector<word_type> m_level1;
+  std::vector<word_type> m_level2;
+
+  static constexpr size_t word_count(size_t bits) {
+    return (bits + WORD_BITS - 1) / WORD_BITS;
+  }
+  static constexpr word_type bit_mask(size_t i) {
+    return word_type{1} << (i % WORD_BITS);
+  }
+  // The bits at and below i's position in its word
+  static constexpr word_type below_or_at(size_t i) {
+    return ~word_type{0} >> (WORD_BITS - 1 - i % WORD_BITS);
+  }
+  static size_t ctz(word_type bits) {
+    return static_cast<size_t>(countr_zero(bits));
+  }
+  // The index of the highest set bit
+  static size_t clz_index(word_type bits) {
+    return WORD_BITS - 1 - static_cast<size_t>(countl_zero(bits));
+  }
+};
+
+}  // namespace misc
@@ -0,0 +1,47 @@
+#pragma once
+#include <limits>
+#include <type_traits>
+
+namespace misc {
+
+/// @brief Declares a representation of T that means "no value" (a niche), so
+/// containers of optional Ts can store presence in the value itself.
+/// @note Not specialized by default. A specialization provides
+/// `static T empty_value()` and `static bool is_empty(const T&)`, usually by
+/// deriving from sentinel_niche or nan_niche. The empty value can't then be
+/// stored as a real value.
+template <typename T, typename = void>
+struct optional_niche {};
+
+/// @brief A niche that's a single sentinel value, e.g. an index of -1
+template <typename T, T Sentinel>
+struct sentinel_niche {
+  [[nodiscard]] static constexpr T empty_value() { return Sentinel; }
+  [[nodiscard]] static constexpr bool is_empty(const T& t) {
+    return t == Sentinel;
+  }
+};
+
+/// @brief A niche for floating point types, where every NaN means empty
+template <typename T>
+struct nan_niche {
+  static_assert(std::numeric_limits<T>::has_quiet_NaN);
+  [[nodiscard]] static constexpr T empty_value() {
+    return std::numeric_limits<T>::quiet_NaN();
+  }
+  [[nodiscard]] static constexpr bool is_empty(const T& t) { return t != t; }
+};
+
+template <typename T, typename = void>
+struct has_optional_niche : std::false_type {};
+
+template <typename T>
+struct has_optional_niche<
+    T, std::void_t<decltype(optional_niche<T>::empty_value()),
+                   decltype(optional_niche<T>::is_empty(std::declval<T>()))>>
+    : std::true_type {};
+
+template <typename T>
+constexpr bool has_optional_niche_v = has_optional_niche<T>::value;
+
+}  // namespace misc
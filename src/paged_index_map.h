@@ -0,0 +1,257 @@
+#pragma once
+#include <iterator>
+#include <memory>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+#include "dense_index_map.h"
+#include "vector_of_optional.h"
+
+namespace misc {
+
+/// @brief A dense_dynamic_index_map whose slots are split into fixed-size
+/// pages, allocated when a key first lands in them.
+/// @tparam Key The key type
+/// @tparam Value The mapped type
+/// @tparam KeyToIndexMap Maps a key to its slot index
+/// @tparam PageSize The number of slots in a page. Must be a power of two, and
+/// at least 64.
+/// @note A page table holds one pointer per page, and a missing page stands
+/// for PageSize empty slots, so sparse keys only cost memory for the pages
+/// they're in, and inserting a key far past the others allocates one page
+/// instead of every slot before it. A page is freed when its last element is
+/// erased. Iteration skips missing pages, and scans each page's occupancy
+/// bits. Elements never move, so pointers to them stay valid until they're
+/// erased.
+template <typename Key, typename Value, typename KeyToIndexMap = identity,
+          size_t PageSize = 4096>
+class paged_dense_index_map {
+  static_assert(PageSize >= 64 && (PageSize & (PageSize - 1)) == 0);
+
+ public:
+  using key_type = Key;
+  using mapped_type = Value;
+  using value_type = std::pair<const Key, Value>;
+  using size_type = size_t;
+
+ protected:
+  using page_type = VectorOfOptional<value_type>;
+
+  template <bool IsConst>
+  class basic_iterator {
+    using map_type =
+        std::conditional_t<IsConst, const paged_dense_index_map,
+                           paged_dense_index_map>;
+
+   public:
+    using iterator_category = std::bidirectional_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = paged_dense_index_map::value_type;
+    using pointer = std::conditional_t<IsConst, const value_type*, value_type*>;
+    using reference =
+        std::conditional_t<IsConst, const value_type&, value_type&>;
+
+    friend class paged_dense_index_map;
+
+    basic_iterator(size_t i, map_type& map) : ind(map.next_set(i)), m(&map) {}
+
+    // An iterator converts to a const_iterator
+    template <bool C = IsConst, typename = std::enable_if_t<C>>
+    basic_iterator(const basic_iterator<false>& it)  // NOLINT
+        : ind(it.ind), m(it.m) {}
+
+    reference operator*() const { return *m->slot(ind); }
+    pointer operator->() const { return m->slot(ind); }
+
+    basic_iterator& operator++() {
+      ind = m->next_set(ind + 1);
+      return *this;
+    }
+    basic_iterator operator++(int) {
+      auto retval = *this;
+      ++*this;
+      return retval;
+    }
+    basic_iterator& operator--() {
+      ind = m->prev_set(ind);
+      return *this;
+    }
+    basic_iterator operator--(int) {
+      auto retval = *this;
+      --*this;
+      return retval;
+    }
+
+    [[nodiscard]] friend bool operator==(const basic_iterator& lhs,
+                                         const basic_iterator& rhs) {
+      return lhs.ind == rhs.ind && lhs.m == rhs.m;
+    }
+    [[nodiscard]] friend bool operator!=(const basic_iterator& lhs,
+                                         const basic_iterator& rhs) {
+      return !(lhs == rhs);
+    }
+
+   private:
+    template <bool>
+    friend class basic_iterator;
+
+    size_t ind;
+    map_type* m;
+  };
+
+ public:
+  using iterator = basic_iterator<false>;
+  using const_iterator = basic_iterator<true>;
+
+  explicit paged_dense_index_map(KeyToIndexMap m = KeyToIndexMap{})
+      : m_index_map(std::move(m)) {}
+
+  paged_dense_index_map(const paged_dense_index_map& o)
+      : m_size(o.m_size), m_index_map(o.m_index_map) {
+    m_pages.reserve(o.m_pages.size());
+    for (const auto& page : o.m_pages) {
+      m_pages.push_back(page ? std::make_unique<page_type>(*page) : nullptr);
+    }
+  }
+
+  paged_dense_index_map(paged_dense_index_map&&) noexcept = default;
+
+  paged_dense_index_map& operator=(const paged_dense_index_map& o) {
+    if (&o != this) *this = paged_dense_index_map(o);
+    return *this;
+  }
+
+  paged_dense_index_map& operator=(paged_dense_index_map&&) noexcept = default;
+
+  [[nodiscard]] size_t size() const { return m_size; }
+
+  [[nodiscard]] bool empty() const { return m_size == 0; }
+
+  /// @brief The number of pages that are allocated
+  [[nodiscard]] size_t page_count() const {
+    size_t retval = 0;
+    for (const auto& page : m_pages) {
+      retval += page != nullptr;
+    }
+    return retval;
+  }
+
+  [[nodiscard]] iterator begin() { return iterator{0, *this}; }
+  [[nodiscard]] const_iterator begin() const {
+    return const_iterator{0, *this};
+  }
+
+  [[nodiscard]] iterator end() { return iterator{end_index(), *this}; }
+  [[nodiscard]] const_iterator end() const {
+    return const_iterator{end_index(), *this};
+  }
+
+  [[nodiscard]] iterator find(const Key& key) {
+    const auto ind = m_index_map(key);
+    return slot(ind) ? iterator{ind, *this} : end();
+  }
+
+  [[nodiscard]] const_iterator find(const Key& key) const {
+    const auto ind = m_index_map(key);
+    return slot(ind) ? const_iterator{ind, *this} : end();
+  }
+
+  [[nodiscard]] Value& operator[](const Key& key) {
+    return emplace(key).first->second;
+  }
+
+  template <typename... Args>
+  std::pair<iterator, bool> emplace(const Key& key, Args&&... args) {
+    const auto ind = m_index_map(key);
+    if (slot(ind)) return {iterator{ind, *this}, false};
+
+    auto& page = get_or_allocate_page(ind / PageSize);
+    page.emplace_at(ind % PageSize, std::piecewise_construct,
+                    std::forward_as_tuple(key),
+                    std::forward_as_tuple(std::forward<Args>(args)...));
+    ++m_size;
+    return {iterator{ind, *this}, true};
+  }
+
+  /// @brief Destroys the element, leaving its slot empty. Frees its page if
+  /// that was the page's last element.
+  /// @return The iterator after it
+  iterator erase(const_iterator it) {
+    auto& page = m_pages[it.ind / PageSize];
+    page->reset(it.ind % PageSize);
+    --m_size;
+    if (page->first_set() == page->size()) page.reset();
+    return iterator{it.ind + 1, *this};
+  }
+
+  /// @return The number of elements erased
+  size_t erase(const Key& key) {
+    const auto it = find(key);
+    if (it == end()) return 0;
+    erase(it);
+    return 1;
+  }
+
+  void clear() {
+    m_pages.clear();
+    m_size = 0;
+  }
+
+ protected:
+  std::vector<std::unique_ptr<page_type>> m_pages;
+  size_t m_size = 0;
+  KeyToIndexMap m_index_map;
+
+  [[nodiscard]] size_t end_index() const { return m_pages.size() * PageSize; }
+
+  [[nodiscard]] value_type* slot(size_t ind) const {
+    const auto p = ind / PageSize;
+    if (p >= m_pages.size() || !m_pages[p]) return nullptr;
+    return m_pages[p]->operator[](ind % PageSize);
+  }
+
+  page_type& get_or_allocate_page(size_t p) {
+    if (p >= m_pages.size()) m_pages.resize(p + 1);
+    auto& page = m_pages[p];
+    if (!page) {
+      page = std::make_unique<page_type>();
+      page->resize(PageSize);
+    }
+    return *page;
+  }
+
+  // The first set slot at or after i, or end_index()
+  [[nodiscard]] size_t next_set(size_t i) const {
+    for (auto p = i / PageSize, offset = i % PageSize; p < m_pages.size();
+         ++p, offset = 0) {
+      if (const auto& page = m_pages[p]) {
+        const auto j = page->next_set(offset);
+        if (j != PageSize) return p * PageSize + j;
+      }
+    }
+    return end_index();
+  }
+
+  // The last set slot before i, or end_index()
+  [[nodiscard]] size_t prev_set(size_t i) const {
+    auto p = i / PageSize;
+    auto offset = i % PageSize;
+    if (p >= m_pages.size()) {
+      p = m_pages.size();
+      offset = 0;
+    }
+    while (true) {
+      if (offset != 0 && m_pages[p]) {
+        const auto j = m_pages[p]->prev_set(offset);
+        if (j != page_type::npos) return p * PageSize + j;
+      }
+      if (p == 0) return end_index();
+      --p;
+      offset = PageSize;
+    }
+  }
+};
+
+}  // namespace misc
@@ -0,0 +1,59 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <future>
+#include <vector>
+
+namespace misc {
+
+/// @brief Splits [0, count) into (at most) num_threads contiguous chunks, and
+/// calls fn(first, last) for each chunk concurrently. The calling thread
+/// handles the last chunk.
+/// @param count The number of items to split
+/// @param num_threads The maximum number of threads to use, including the
+/// calling thread
+/// @param fn Called with the half-open range of each chunk
+/// @note Returns once every chunk has been handled. If any call throws, the
+/// first exception is rethrown (after every chunk has finished).
+template <typename Fn>
+void parallel_for(size_t count, size_t num_threads, Fn&& fn) {
+  num_threads = std::min(num_threads, count);
+  if (num_threads < 2) {
+    fn(size_t{0}, count);
+    return;
+  }
+
+  const auto chunk = count / num_threads;
+  const auto remainder = count % num_threads;
+
+  std::vector<std::future<void>> futures;
+  futures.reserve(num_threads - 1);
+  size_t first = 0;
+  for (size_t t = 0; t + 1 < num_threads; ++t) {
+    const auto last = first + chunk + (t < remainder ? 1 : 0);
+    futures.push_back(std::async(std::launch::async,
+                                 [&fn, first, last] { fn(first, last); }));
+    first = last;
+  }
+
+  // The futures' destructors wait for the other chunks, even if this throws
+  fn(first, count);
+  for (auto& f : futures) {
+    f.get();
+  }
+}
+
+/// @brief Like parallel_for, but every chunk boundary (apart from count) is a
+/// multiple of alignment
+/// @note E.g. splitting the slots of a bitmap at word boundaries means no
+/// two threads share a word.
+template <typename Fn>
+void parallel_for_aligned(size_t count, size_t alignment, size_t num_threads,
+                          Fn&& fn) {
+  const auto blocks = (count + alignment - 1) / alignment;
+  parallel_for(blocks, num_threads, [&](size_t first, size_t last) {
+    fn(first * alignment, std::min(last * alignment, count));
+  });
+}
+
+}  // namespace misc
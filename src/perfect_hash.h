@@ -0,0 +1,139 @@
+#pragma once
+#include <array>
+#include <cassert>
+#include <cstddef>
+#include <cstdint>
+#include <stdexcept>
+#include <string_view>
+
+namespace misc {
+
+/// @brief A minimal perfect hash of a fixed set of N strings, built at compile
+/// time, that maps each of them to a distinct index in [0, N).
+/// @tparam N The number of keys
+/// @note Built with hash-and-displace: the keys are split into N buckets by a
+/// first hash, and, largest bucket first, each bucket gets the smallest seed
+/// that sends all its keys to free slots. A lookup is then two hashes, one
+/// seed load and one string comparison, with no collisions to resolve. It can
+/// be used as both the KeyToIndexMap and the IndexToKey of a
+/// dense_dynamic_index_map over std::string_view keys, pre-sized to N, which
+/// then rejects unknown keys on insert.
+/// Duplicate keys throw std::invalid_argument (a compile error when built in
+/// a constant expression).
+template <size_t N>
+class perfect_hash_index {
+  static_assert(N > 0);
+
+ public:
+  constexpr explicit perfect_hash_index(
+      const std::array<std::string_view, N>& keys) {
+    // Sort the key indices by bucket, so each bucket's keys are contiguous
+    std::array<size_t, N> bucket_of{};
+    std::array<size_t, N + 1> bucket_begin{};
+    for (size_t k = 0; k < N; ++k) {
+      bucket_of[k] = static_cast<size_t>(hash(keys[k], 0) % N);
+      ++bucket_begin[bucket_of[k] + 1];
+    }
+    for (size_t b = 0; b < N; ++b) {
+      bucket_begin[b + 1] += bucket_begin[b];
+    }
+    std::array<size_t, N> members{};
+    auto next = bucket_begin;
+    for (size_t k = 0; k < N; ++k) {
+      members[next[bucket_of[k]]++] = k;
+    }
+
+    // Equal keys always share a bucket
+    size_t max_bucket_size = 0;
+    for (size_t b = 0; b < N; ++b) {
+      const auto first = bucket_begin[b];
+      const auto last = bucket_begin[b + 1];
+      for (auto i = first; i < last; ++i) {
+        for (auto j = first; j < i; ++j) {
+          if (keys[members[i]] == keys[members[j]]) {
+            throw std::invalid_argument("perfect_hash_index: duplicate key");
+          }
+        }
+      }
+      if (last - first > max_bucket_size) max_bucket_size = last - first;
+    }
+
+    std::array<bool, N> taken{};
+    std::array<size_t, N> slots{};
+    for (auto n = max_bucket_size; n > 0; --n) {
+      for (size_t b = 0; b < N; ++b) {
+        if (bucket_begin[b + 1] - bucket_begin[b] != n) continue;
+        place_bucket(keys, members.data() + bucket_begin[b], n, b, taken,
+                     slots);
+      }
+    }
+  }
+
+  /// @brief The number of keys, and so of slots
+  [[nodiscard]] static constexpr size_t size() { return N; }
+
+  /// @brief The index of every string that isn't one of the keys
+  static constexpr size_t npos = N;
+
+  /// @return The key's index, or npos if it isn't one of the keys
+  [[nodiscard]] constexpr size_t operator()(std::string_view key) const {
+    const auto seed = m_seeds[hash(key, 0) % N];
+    const auto i = static_cast<size_t>(hash(key, seed) % N);
+    return m_keys[i] == key ? i : npos;
+  }
+
+  /// @return The key at index i
+  [[nodiscard]] constexpr std::string_view operator()(size_t i) const {
+    assert(i < N);
+    return m_keys[i];
+  }
+
+ protected:
+  std::array<uint32_t, N> m_seeds{};
+  std::array<std::string_view, N> m_keys{};
+
+  // FNV-1a, seeded, then mixed so the low bits depend on every byte
+  [[nodiscard]] static constexpr uint64_t hash(std::string_view s,
+                                               uint32_t seed) {
+    uint64_t h = 0xcbf29ce484222325 ^ (seed * 0x9e3779b97f4a7c15);
+    for (const auto c : s) {
+      h ^= static_cast<unsigned char>(c);
+      h *= 0x100000001b3;
+    }
+    h ^= h >> 33;
+    h *= 0xff51afd7ed558ccd;
+    h ^= h >> 33;
+    return h;
+  }
+
+  // Finds the first seed (from 1) that sends bucket b's n keys, whose
+  // indices are members[0, n), to distinct free slots, and takes those slots.
+  // slots is scratch space for the attempt.
+  constexpr void place_bucket(const std::array<std::string_view, N>& keys,
+                              const size_t* members, size_t n, size_t b,
+                              std::array<bool, N>& taken,
+                              std::array<size_t, N>& slots) {
+    for (uint32_t seed = 1;; ++seed) {
+      bool fits = true;
+      for (size_t i = 0; i < n && fits; ++i) {
+        const auto slot =
+            static_cast<size_t>(hash(keys[members[i]], seed) % N);
+        fits = !taken[slot];
+        for (size_t j = 0; j < i && fits; ++j) {
+          fits = slots[j] != slot;
+        }
+        slots[i] = slot;
+      }
+      if (!fits) continue;
+
+      m_seeds[b] = seed;
+      for (size_t i = 0; i < n; ++i) {
+        taken[slots[i]] = true;
+        m_keys[slots[i]] = keys[members[i]];
+      }
+      return;
+    }
+  }
+};
+
+}  // namespace misc
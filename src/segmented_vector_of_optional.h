@@ -0,0 +1,265 @@
+#pragma once
+#include <algorithm>
+#include <cassert>
+#include <climits>
+#include <cstdint>
+#include <memory>
+#include <memory_resource>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "allocated_storages.h"
+#include "bit_scan.h"
+#include "log2.h"
+
+namespace misc {
+
+/// @brief A vector of optional elements, stored in segments that never move.
+/// @tparam T The element type
+/// @tparam FirstSegmentSize The number of slots in the first segment. Must be
+/// a power of two, and at least 64.
+/// @note Segment k holds FirstSegmentSize * 2^k slots, so growing allocates a
+/// new segment instead of moving every element, and the pointers returned by
+/// operator[] stay valid until their element is reset. Finding a slot's
+/// segment takes one log2. Unlike VectorOfOptional, there's no insertion or
+/// erasure in the middle, since that would move elements.
+template <typename T, size_t FirstSegmentSize = 64>
+class segmented_vector_of_optional {
+  static_assert(FirstSegmentSize >= 64 &&
+                (FirstSegmentSize & (FirstSegmentSize - 1)) == 0);
+
+ protected:
+  using word_type = uint64_t;
+  using segment_type = allocated_storages<word_type, T>;
+
+  static constexpr size_t WORD_BITS = sizeof(word_type) * CHAR_BIT;
+  static constexpr size_t BITS_STORE_IND = 0;
+  static constexpr size_t DATA_STORE_IND = 1;
+  static constexpr size_t FIRST_SEGMENT_BITS =
+      static_cast<size_t>(log2(FirstSegmentSize));
+
+ public:
+  using value_type = T;
+  using size_type = size_t;
+
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  segmented_vector_of_optional() = default;
+
+  /// @param resource Where to allocate segments from. nullptr means
+  /// std::aligned_alloc. It must outlive the vector.
+  explicit segmented_vector_of_optional(std::pmr::memory_resource* resource)
+      : m_resource(resource) {}
+
+  segmented_vector_of_optional(const segmented_vector_of_optional& o) {
+    resize(o.size());
+    o.for_each_set([&](size_t i, const T& t) { emplace_at(i, t); });
+  }
+
+  segmented_vector_of_optional(segmented_vector_of_optional&& o) noexcept
+      : m_segments(std::move(o.m_segments)),
+        m_size(std::exchange(o.m_size, 0)),
+        m_resource(o.m_resource) {}
+
+  segmented_vector_of_optional& operator=(
+      const segmented_vector_of_optional& o) {
+    if (&o != this) {
+      segmented_vector_of_optional copy{m_resource};
+      copy.resize(o.size());
+      o.for_each_set([&](size_t i, const T& t) { copy.emplace_at(i, t); });
+      *this = std::move(copy);
+    }
+    return *this;
+  }
+
+  segmented_vector_of_optional& operator=(
+      segmented_vector_of_optional&& o) noexcept {
+    using std::swap;
+    swap(m_segments, o.m_segments);
+    swap(m_size, o.m_size);
+    swap(m_resource, o.m_resource);
+    return *this;
+  }
+
+  ~segmented_vector_of_optional() { clear(); }
+
+  /// @brief The resource segments are allocated from, or nullptr for
+  /// std::aligned_alloc
+  [[nodiscard]] std::pmr::memory_resource* get_memory_resource() const {
+    return m_resource;
+  }
+
+  [[nodiscard]] size_t size() const { return m_size; }
+
+  [[nodiscard]] size_t capacity() const {
+    return segment_start(m_segments.size());
+  }
+
+  [[nodiscard]] T* operator[](size_t pos) {
+    const auto [k, offset] = locate(pos);
+    return is_bit_set(words(k), offset) ? data(k) + offset : nullptr;
+  }
+
+  [[nodiscard]] const T* operator[](size_t pos) const {
+    return const_cast<segmented_vector_of_optional*>(this)->operator[](pos);
+  }
+
+  T* push_back(const T& arg) { return emplace_back(arg); }
+
+  T* push_back(T&& arg) { return emplace_back(std::move(arg)); }
+
+  template <typename... Args>
+  T* emplace_back(Args&&... args) {
+    resize(m_size + 1);
+    return emplace_at(m_size - 1, std::forward<Args>(args)...);
+  }
+
+  /// @brief Constructs an element in a slot, destroying any element in it
+  /// @param pos The slot. It must be below size().
+  template <typename... Args>
+  T* emplace_at(size_t pos, Args&&... args) {
+    assert(pos < m_size);
+    reset(pos);
+    const auto [k, offset] = locate(pos);
+    auto* retval = new (data(k) + offset) T(std::forward<Args>(args)...);
+    words(k)[offset / WORD_BITS] |= bit_mask(offset);
+    return retval;
+  }
+
+  T* emplace_at(size_t pos, std::nullopt_t) {
+    reset(pos);
+    return nullptr;
+  }
+
+  void reset(size_t pos) {
+    const auto [k, offset] = locate(pos);
+    auto w = words(k);
+    if (is_bit_set(w, offset)) {
+      w[offset / WORD_BITS] &= ~bit_mask(offset);
+      std::destroy_at(data(k) + offset);
+    }
+  }
+
+  void resize(size_t s) {
+    if (s < m_size) {
+      for (auto i = next_set(s); i != m_size; i = next_set(i + 1)) {
+        reset(i);
+      }
+    } else {
+      reserve(s);
+    }
+    m_size = s;
+  }
+
+  /// @brief Allocates segments until there's room for s slots. Existing
+  /// elements don't move.
+  void reserve(size_t s) {
+    while (capacity() < s) {
+      const auto len = segment_size(m_segments.size());
+      auto& segment =
+          m_segments.emplace_back(m_resource, len / WORD_BITS, len);
+      const auto bits_range = segment.template get<BITS_STORE_IND>();
+      std::fill(bits_range.begin(), bits_range.end(), word_type{0});
+    }
+  }
+
+  void clear() { resize(0); }
+
+  /// @brief The number of slots holding a value
+  [[nodiscard]] size_t count() const {
+    size_t retval = 0;
+    for (size_t k = 0; segment_start(k) < m_size; ++k) {
+      const auto w = words(k);
+      for (size_t i = 0; i < used_words(k); ++i) {
+        retval += static_cast<size_t>(popcount(w[i]));
+      }
+    }
+    return retval;
+  }
+
+  /// @brief The first slot at or after pos that holds a value
+  /// @return The slot's index, or size() if there is none
+  [[nodiscard]] size_t next_set(size_t pos) const {
+    if (pos >= m_size) return m_size;
+    auto [k, offset] = locate(pos);
+    for (; segment_start(k) < m_size; ++k, offset = 0) {
+      const auto w = words(k);
+      const auto n_words = used_words(k);
+      auto i = offset / WORD_BITS;
+      auto bits = w[i] & (~word_type{0} << (offset % WORD_BITS));
+      while (true) {
+        if (bits != 0) {
+          return segment_start(k) + i * WORD_BITS +
+                 static_cast<size_t>(countr_zero(bits));
+        }
+        if (++i == n_words) break;
+        bits = w[i];
+      }
+    }
+    return m_size;
+  }
+
+  /// @brief The first slot that holds a value
+  /// @return The slot's index, or size() if there is none
+  [[nodiscard]] size_t first_set() const { return next_set(0); }
+
+  /// @brief Calls f(index, value) for each slot holding a value, in order
+  template <typename F>
+  void for_each_set(F&& f) {
+    for (auto i = first_set(); i != m_size; i = next_set(i + 1)) {
+      f(i, *operator[](i));
+    }
+  }
+
+  template <typename F>
+  void for_each_set(F&& f) const {
+    for (auto i = first_set(); i != m_size; i = next_set(i + 1)) {
+      f(i, *operator[](i));
+    }
+  }
+
+ protected:
+  std::vector<segment_type> m_segments;
+  size_t m_size = 0;
+  std::pmr::memory_resource* m_resource = nullptr;
+
+  [[nodiscard]] static constexpr size_t segment_size(size_t k) {
+    return FirstSegmentSize << k;
+  }
+
+  [[nodiscard]] static constexpr size_t segment_start(size_t k) {
+    return FirstSegmentSize * ((size_t{1} << k) - 1);
+  }
+
+  // Returns the segment holding slot i, and i's offset in it
+  [[nodiscard]] static std::pair<size_t, size_t> locate(size_t i) {
+    const auto j = i + FirstSegmentSize;
+    const auto top = static_cast<size_t>(log2(j));
+    return {top - FIRST_SEGMENT_BITS, j - (size_t{1} << top)};
+  }
+
+  // The number of segment k's words that cover slots below size()
+  [[nodiscard]] size_t used_words(size_t k) const {
+    const auto len = std::min(segment_size(k), m_size - segment_start(k));
+    return (len + WORD_BITS - 1) / WORD_BITS;
+  }
+
+  [[nodiscard]] arr_range<word_type> words(size_t k) const {
+    return m_segments[k].template get<BITS_STORE_IND>();
+  }
+
+  [[nodiscard]] T* data(size_t k) const {
+    return m_segments[k].template get<DATA_STORE_IND>().begin();
+  }
+
+  static constexpr word_type bit_mask(size_t i) {
+    return word_type{1} << (i % WORD_BITS);
+  }
+
+  static bool is_bit_set(arr_range<word_type> w, size_t i) {
+    return w[i / WORD_BITS] & bit_mask(i);
+  }
+};
+
+}  // namespace misc
@@ -0,0 +1,161 @@
+#pragma once
+#include <cassert>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <utility>
+
+#include "addressable_minmax_heap.h"
+
+namespace misc {
+
+/// @brief Tracks a quantile (e.g. the median) of a sliding window over a
+/// stream, where the oldest samples can be expired.
+/// @tparam T The sample type
+/// @tparam Comp The comparison operator
+/// @note The window is split between two addressable_minmax_heaps: the lower
+/// part, whose back() is the quantile, and the upper part. Inserting and
+/// expiring are O(log w), reading the quantile is O(1).
+template <typename T, typename Comp = std::less<T>>
+class sliding_window_quantile {
+  struct sample;
+
+  struct node {
+    T value;
+    // The sample's entry in arrival order. A deque's elements stay put when
+    // pushing and popping at its ends.
+    sample* owner;
+  };
+
+  struct node_compare {
+    Comp comp;
+    [[nodiscard]] bool operator()(const node& l, const node& r) const {
+      return comp(l.value, r.value);
+    }
+  };
+
+  using heap_type = addressable_minmax_heap<node, node_compare>;
+
+  struct sample {
+    bool in_lower;
+    typename heap_type::handle handle;
+  };
+
+ public:
+  using value_type = T;
+  using value_compare = Comp;
+  using size_type = size_t;
+  using const_reference = const T&;
+
+  /// @param q The quantile to track, in [0, 1]. For a window of n samples,
+  /// it's the sample of 0-based rank floor(q * (n - 1)), so 0.5 gives the
+  /// lower median.
+  explicit sliding_window_quantile(double q = 0.5,
+                                   const value_compare& comp = value_compare{})
+      : m_lower(node_compare{comp}),
+        m_upper(node_compare{comp}),
+        m_q(q),
+        m_comp(comp) {
+    assert(q >= 0 && q <= 1);
+  }
+
+  // Nodes point into m_samples
+  sliding_window_quantile(const sliding_window_quantile&) = delete;
+  sliding_window_quantile& operator=(const sliding_window_quantile&) = delete;
+
+  [[nodiscard]] bool empty() const { return m_samples.empty(); }
+
+  [[nodiscard]] size_type size() const { return m_samples.size(); }
+
+  /// @brief The tracked quantile of the samples in the window
+  [[nodiscard]] const_reference quantile() const {
+    assert(!empty());
+    return m_lower.back().value;
+  }
+
+  /// @brief Adds a sample as the newest in the window
+  void push(T t) {
+    insert(std::move(t));
+    rebalance();
+  }
+
+  /// @brief Removes the oldest sample in the window
+  void expire() {
+    remove_oldest();
+    rebalance();
+  }
+
+  /// @brief Expires the n_expired oldest samples, then adds [first, last) as
+  /// the newest samples. The heaps are only rebalanced once, which saves
+  /// moving samples back and forth within a batch.
+  template <typename InputIt>
+  void advance(InputIt first, InputIt last, size_t n_expired) {
+    assert(n_expired <= size());
+    for (; n_expired > 0; --n_expired) {
+      remove_oldest();
+    }
+    for (; first != last; ++first) {
+      insert(*first);
+    }
+    rebalance();
+  }
+
+  void clear() {
+    m_lower.clear();
+    m_upper.clear();
+    m_samples.clear();
+  }
+
+  [[nodiscard]] value_compare value_comp() const { return m_comp; }
+
+ protected:
+  // Every sample in m_lower compares no greater than every sample in m_upper
+  heap_type m_lower;
+  heap_type m_upper;
+  std::deque<sample> m_samples;
+  double m_q;
+  value_compare m_comp;
+
+  [[nodiscard]] size_t lower_target() const {
+    if (m_samples.empty()) return 0;
+    return static_cast<size_t>(
+               std::floor(m_q * static_cast<double>(m_samples.size() - 1))) +
+           1;
+  }
+
+  void insert(T t) {
+    auto& s = m_samples.emplace_back();
+    s.in_lower = !m_lower.empty() && !m_comp(m_lower.back().value, t);
+    try {
+      s.handle =
+          (s.in_lower ? m_lower : m_upper).push(node{std::move(t), &s});
+    } catch (...) {
+      // Don't leave a sample that isn't in either heap
+      m_samples.pop_back();
+      throw;
+    }
+  }
+
+  void remove_oldest() {
+    assert(!empty());
+    auto& s = m_samples.front();
+    (s.in_lower ? m_lower : m_upper).erase(s.handle);
+    m_samples.pop_front();
+  }
+
+  void rebalance() {
+    const auto target = lower_target();
+    while (m_lower.size() > target) {
+      auto n = m_lower.pop_back_value();
+      n.owner->in_lower = false;
+      n.owner->handle = m_upper.push(std::move(n));
+    }
+    while (m_lower.size() < target) {
+      auto n = m_upper.pop_front_value();
+      n.owner->in_lower = true;
+      n.owner->handle = m_lower.push(std::move(n));
+    }
+  }
+};
+
+}  // namespace misc
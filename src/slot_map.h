@@ -0,0 +1,141 @@
+#pragma once
+#include <cstdint>
+#include <limits>
+#include <utility>
+#include <vector>
+
+#include "vector_of_optional.h"
+
+namespace misc {
+
+/// @brief Identifies an element of a slot_map. It stays valid until that
+/// element is erased, after which the map rejects it.
+struct slot_map_handle {
+  uint32_t index;
+  uint32_t generation;
+
+  [[nodiscard]] friend bool operator==(const slot_map_handle& lhs,
+                                       const slot_map_handle& rhs) {
+    return lhs.index == rhs.index && lhs.generation == rhs.generation;
+  }
+  [[nodiscard]] friend bool operator!=(const slot_map_handle& lhs,
+                                       const slot_map_handle& rhs) {
+    return !(lhs == rhs);
+  }
+};
+
+/// @brief A container that hands out handles to its elements, and detects
+/// handles whose element has been erased.
+/// @tparam T The element type
+/// @tparam Summary The occupancy summary policy of the element storage
+/// @note Elements live in a VectorOfOptional, and iterating scans its
+/// occupancy bits. Each slot has a generation, which is
+/// bumped when its element is erased, and a handle is only valid while its
+/// generation matches. Erased slots go on a free list, threaded through the
+/// slots' bookkeeping, and are reused before the storage grows. insert, get
+/// and erase are all O(1) (insert amortized).
+template <typename T, typename Summary = flat_occupancy>
+class slot_map {
+ public:
+  using value_type = T;
+  using size_type = size_t;
+  using handle = slot_map_handle;
+
+  [[nodiscard]] size_t size() const { return m_size; }
+
+  [[nodiscard]] bool empty() const { return m_size == 0; }
+
+  /// @brief The number of slots, including those on the free list
+  [[nodiscard]] size_t slot_count() const { return m_slots.size(); }
+
+  /// @brief Constructs an element, reusing the most recently erased slot if
+  /// there is one
+  /// @return The element's handle
+  template <typename... Args>
+  handle insert(Args&&... args) {
+    if (m_free_head != NO_SLOT) {
+      const auto i = m_free_head;
+      m_values.emplace_at(i, std::forward<Args>(args)...);
+      m_free_head = m_slots[i].next_free;
+      ++m_size;
+      return {i, m_slots[i].generation};
+    }
+
+    const auto i = static_cast<uint32_t>(m_slots.size());
+    m_slots.push_back({0, NO_SLOT});
+    try {
+      m_values.emplace_back(std::forward<Args>(args)...);
+    } catch (...) {
+      m_slots.pop_back();
+      throw;
+    }
+    ++m_size;
+    return {i, 0};
+  }
+
+  /// @return The handle's element, or nullptr if it has been erased
+  [[nodiscard]] T* get(handle h) {
+    return contains(h) ? m_values[h.index] : nullptr;
+  }
+
+  [[nodiscard]] const T* get(handle h) const {
+    return const_cast<slot_map*>(this)->get(h);
+  }
+
+  [[nodiscard]] bool contains(handle h) const {
+    return h.index < m_slots.size() &&
+           m_slots[h.index].generation == h.generation &&
+           m_values[h.index] != nullptr;
+  }
+
+  /// @brief Destroys the handle's element, if it's still there
+  /// @return Whether an element was erased
+  bool erase(handle h) {
+    if (!contains(h)) return false;
+    m_values.reset(h.index);
+    auto& s = m_slots[h.index];
+    ++s.generation;
+    s.next_free = m_free_head;
+    m_free_head = h.index;
+    --m_size;
+    return true;
+  }
+
+  /// @brief Destroys every element. Every existing handle becomes invalid.
+  void clear() {
+    m_values.for_each_set([&](size_t i, T&) {
+      erase({static_cast<uint32_t>(i), m_slots[i].generation});
+    });
+  }
+
+  /// @brief Calls f(handle, value) for each element, in slot order
+  template <typename F>
+  void for_each(F&& f) {
+    m_values.for_each_set([&](size_t i, T& t) {
+      f(handle{static_cast<uint32_t>(i), m_slots[i].generation}, t);
+    });
+  }
+
+  template <typename F>
+  void for_each(F&& f) const {
+    m_values.for_each_set([&](size_t i, const T& t) {
+      f(handle{static_cast<uint32_t>(i), m_slots[i].generation}, t);
+    });
+  }
+
+ protected:
+  static constexpr uint32_t NO_SLOT = std::numeric_limits<uint32_t>::max();
+
+  struct slot_info {
+    uint32_t generation;
+    // The next slot on the free list, while this one is on it
+    uint32_t next_free;
+  };
+
+  VectorOfOptional<T, Summary> m_values;
+  std::vector<slot_info> m_slots;
+  uint32_t m_free_head = NO_SLOT;
+  size_t m_size = 0;
+};
+
+}  // namespace misc
@@ -0,0 +1,17 @@
+#pragma once
+#include <type_traits>
+
+namespace misc {
+
+/// @brief Whether moving a T to a new address and destroying the original
+/// can be done with a memcpy instead.
+/// @note True for trivially copyable types. Specialize it as true_type for
+/// other types that qualify (most types that only own heap memory, e.g.
+/// std::unique_ptr-like handles), so containers can relocate them in bulk.
+template <typename T>
+struct is_trivially_relocatable : std::is_trivially_copyable<T> {};
+
+template <typename T>
+constexpr bool is_trivially_relocatable_v = is_trivially_relocatable<T>::value;
+
+}  // namespace misc
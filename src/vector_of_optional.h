@@ -1,57 +1,79 @@
 #pragma once
 
 #include <climits>
+#include <cstdint>
+#include <cstring>
 #include <iterator>
+#include <memory>
+#include <memory_resource>
 #include <optional>
 #include <type_traits>
 #include <utility>
+#include <vector>
 
 #include "allocated_storages.h"
+#include "bit_scan.h"
+#include "occupancy_summary.h"
+#include "optional_niche.h"
+#include "trivially_relocatable.h"
 
 namespace misc {
 
-namespace details {
-struct octet {
-  uint8_t bits;
-  bool operator==(const octet& rhs) const { return bits == rhs.bits; }
-  bool operator!=(const octet& rhs) const { return !(*this == rhs); }
-};
-}  // namespace details
-
-template <typename T>
+/// @tparam T The element type
+/// @tparam Summary How occupancy is summarized to speed up searching for set
+/// slots: flat_occupancy, or summarized_occupancy for very sparse vectors
+/// @note Types with an optional_niche get a specialization without the
+/// occupancy bits, see below.
+template <typename T, typename Summary = flat_occupancy,
+          typename Enable = void>
 class VectorOfOptional {
  protected:
   size_t curr_size = 0;
 
+  // Occupancy is kept in 64-bit words, so scans can skip over 64 empty slots
+  // at a time. Bits at or past size() are always clear.
+  using word_type = uint64_t;
+  static constexpr size_t WORD_BITS = sizeof(word_type) * CHAR_BIT;
+
   static constexpr size_t BITS_STORE_IND = 0;
   static constexpr size_t DATA_STORE_IND = 1;
-  static allocated_storages<details::octet, T> make_storages(size_t capacity) {
-    allocated_storages<details::octet, T> storages{
-        (capacity + CHAR_BIT - 1) / CHAR_BIT, capacity};
+
+  static constexpr size_t word_count(size_t bits) {
+    return (bits + WORD_BITS - 1) / WORD_BITS;
+  }
+
+  // A null resource allocates with std::aligned_alloc
+  static allocated_storages<word_type, T> make_storages(
+      size_t capacity, std::pmr::memory_resource* resource) {
+    allocated_storages<word_type, T> storages{resource, word_count(capacity),
+                                              capacity};
     const auto& bits_range = storages.template get<BITS_STORE_IND>();
-    std::fill(bits_range.begin(), bits_range.end(), details::octet{0x00});
+    std::fill(bits_range.begin(), bits_range.end(), word_type{0});
     return storages;
   }
 
-  allocated_storages<details::octet, T> storages;
+  allocated_storages<word_type, T> storages;
+  Summary occupancy_summary;
 
   T* data() {
     return reinterpret_cast<T*>(
         storages.template get<DATA_STORE_IND>().begin());
   }
 
-  static bool is_bit_set(size_t i, arr_range<details::octet> octs) {
-    return octs[i / CHAR_BIT].bits & (1 << (i & ((1 << CHAR_BIT) - 1)));
+  static constexpr word_type bit_mask(size_t i) {
+    return word_type{1} << (i % WORD_BITS);
+  }
+
+  static bool is_bit_set(size_t i, arr_range<word_type> words) {
+    return words[i / WORD_BITS] & bit_mask(i);
   }
 
-  static void set_bit(size_t i, arr_range<details::octet> bit_range) {
-    bit_range[i / CHAR_BIT].bits |=
-        static_cast<uint8_t>(1u << (i & ((1 << CHAR_BIT) - 1u)));
+  static void set_bit(size_t i, arr_range<word_type> words) {
+    words[i / WORD_BITS] |= bit_mask(i);
   }
 
-  static void reset_bit(size_t i, arr_range<details::octet> bit_range) {
-    bit_range[i >> uint8_t{CHAR_BIT}].bits &=
-        static_cast<uint8_t>(~(1u << (i & ((1 << CHAR_BIT) - 1u))));
+  static void reset_bit(size_t i, arr_range<word_type> words) {
+    words[i / WORD_BITS] &= ~bit_mask(i);
   }
 
   bool is_set(size_t i) const {
@@ -59,15 +81,14 @@ class VectorOfOptional {
   }
 
   void set_bit(size_t i) {
-    auto bit_range = storages.template get<BITS_STORE_IND>();
-    set_bit(i, bit_range);
-    bit_range[i / CHAR_BIT].bits |=
-        static_cast<uint8_t>(1u << (i & ((1 << CHAR_BIT) - 1u)));
+    set_bit(i, storages.template get<BITS_STORE_IND>());
+    occupancy_summary.word_set(i / WORD_BITS);
   }
 
   void reset_bit(size_t i) {
-    auto bit_range = storages.template get<BITS_STORE_IND>();
-    reset_bit(i, bit_range);
+    auto words = storages.template get<BITS_STORE_IND>();
+    reset_bit(i, words);
+    occupancy_summary.word_cleared(words, i / WORD_BITS);
   }
 
   static size_t exp_reallocation_size(size_t s) {
@@ -75,12 +96,17 @@ class VectorOfOptional {
   }
 
   void maybe_reallocate_and_copy_exact(size_t s) {
-    auto tmp_storages = make_storages(s);
+    auto tmp_storages = make_storages(s, get_memory_resource());
 
-    this->copy_to_empty_storages(std::move(storages), tmp_storages);
+    if constexpr (is_trivially_relocatable_v<T>) {
+      relocate(storages, tmp_storages, size());
+    } else {
+      this->copy_to_empty_storages(std::move(storages), tmp_storages);
+    }
 
     using std::swap;
     swap(storages, tmp_storages);
+    occupancy_summary.assign(storages.template get<BITS_STORE_IND>());
     destroy_arr_elements(tmp_storages);
   }
 
@@ -89,15 +115,85 @@ class VectorOfOptional {
     maybe_reallocate_and_copy_exact(exp_reallocation_size(s));
   }
 
-  static void destroy_arr_elements(
-      allocated_storages<details::octet, T>& storages) {
-    const auto& data_range = storages.template get<DATA_STORE_IND>();
-    const auto& bits_range = storages.template get<BITS_STORE_IND>();
-    for (size_t i = 0; i < data_range.size(); ++i) {
-      if (is_bit_set(i, bits_range)) {
-        std::destroy_at(data_range.begin() + i);
+  // Calls f(i) for each set bit in [first, last), in increasing order
+  template <typename F>
+  static void for_each_set_bit(arr_range<word_type> words, size_t first,
+                               size_t last, F&& f) {
+    if (first >= last) return;
+    const auto last_word = (last - 1) / WORD_BITS;
+    for (auto w = first / WORD_BITS; w <= last_word; ++w) {
+      auto bits = words[w];
+      if (w == first / WORD_BITS) bits &= ~word_type{0} << (first % WORD_BITS);
+      if (w == last_word && last % WORD_BITS != 0) {
+        bits &= ~(~word_type{0} << (last % WORD_BITS));
+      }
+      for (; bits != 0; bits &= bits - 1) {
+        f(w * WORD_BITS + static_cast<size_t>(countr_zero(bits)));
+      }
+    }
+  }
+
+  // Moves the bits in [pos, last) up by one, to [pos + 1, last + 1), and
+  // clears bit pos
+  static void shift_bits_up(arr_range<word_type> words, size_t pos,
+                            size_t last) {
+    const auto first_word = pos / WORD_BITS;
+    for (auto w = last / WORD_BITS; w > first_word; --w) {
+      words[w] = (words[w] << 1) | (words[w - 1] >> (WORD_BITS - 1));
+    }
+    const auto below = bit_mask(pos) - 1;
+    words[first_word] = (words[first_word] & below) |
+                        ((words[first_word] << 1) & ~below & ~bit_mask(pos));
+  }
+
+  // Moves the bits in [pos + 1, last) down by one, to [pos, last - 1), and
+  // clears bit last - 1
+  static void shift_bits_down(arr_range<word_type> words, size_t pos,
+                              size_t last) {
+    const auto first_word = pos / WORD_BITS;
+    const auto last_word = (last - 1) / WORD_BITS;
+    const auto below = bit_mask(pos) - 1;
+    for (auto w = first_word; w <= last_word; ++w) {
+      auto shifted = words[w] >> 1;
+      if (w != last_word) shifted |= words[w + 1] << (WORD_BITS - 1);
+      words[w] =
+          w == first_word ? (words[w] & below) | (shifted & ~below) : shifted;
+    }
+  }
+
+  // Relocates the first n slots to another allocation with memcpy, and
+  // clears the source bits. Only for trivially relocatable T.
+  static void relocate(allocated_storages<word_type, T>& from,
+                       allocated_storages<word_type, T>& to, size_t n) {
+    static_assert(is_trivially_relocatable_v<T>);
+    if (n == 0) return;
+    std::memcpy(static_cast<void*>(to.template get<DATA_STORE_IND>().begin()),
+                from.template get<DATA_STORE_IND>().begin(), n * sizeof(T));
+    auto from_words = from.template get<BITS_STORE_IND>();
+    std::memcpy(to.template get<BITS_STORE_IND>().begin(), from_words.begin(),
+                word_count(n) * sizeof(word_type));
+    std::fill_n(from_words.begin(), word_count(n), word_type{0});
+  }
+
+  // Calls f(i) for each set slot, skipping empty words through the summary
+  template <typename F>
+  void for_each_set_index(F&& f) const {
+    const auto words = storages.template get<BITS_STORE_IND>();
+    const auto n_words = word_count(size());
+    for (auto w = occupancy_summary.next_word(words, 0, n_words); w < n_words;
+         w = occupancy_summary.next_word(words, w + 1, n_words)) {
+      for (auto bits = words[w]; bits != 0; bits &= bits - 1) {
+        f(w * WORD_BITS + static_cast<size_t>(countr_zero(bits)));
       }
     }
+  }
+
+  static void destroy_arr_elements(allocated_storages<word_type, T>& storages) {
+    const auto& data_range = storages.template get<DATA_STORE_IND>();
+    const auto& bits_range = storages.template get<BITS_STORE_IND>();
+    for_each_set_bit(bits_range, 0, data_range.size(), [&](size_t i) {
+      std::destroy_at(data_range.begin() + i);
+    });
 
     std::destroy_n(bits_range.begin(), bits_range.size());
   }
@@ -112,15 +208,15 @@ class VectorOfOptional {
     std::copy(from_bits_range.begin(), from_bits_range.end(),
               to_bits_range.begin());
 
-    for (size_t i = 0; i < from_data_range.size(); ++i) {
-      if (is_bit_set(i, from_bits_range)) {
-        if constexpr (std::is_rvalue_reference_v<Array1&&>) {
-          new (to_data_range.begin() + i) T(std::move(from_data_range[i]));
-        } else {
-          new (to_data_range.begin() + i) T(from_data_range[i]);
-        }
-      }
-    }
+    for_each_set_bit(from_bits_range, 0, from_data_range.size(),
+                     [&](size_t i) {
+                       if constexpr (std::is_rvalue_reference_v<Array1&&>) {
+                         new (to_data_range.begin() + i)
+                             T(std::move(from_data_range[i]));
+                       } else {
+                         new (to_data_range.begin() + i) T(from_data_range[i]);
+                       }
+                     });
   }
 
  public:
@@ -177,7 +273,8 @@ class VectorOfOptional {
 
     friend difference_type operator-(const const_iterator& lhs,
                                      const const_iterator& rhs) {
-      return lhs.in - rhs.ind;
+      return static_cast<difference_type>(lhs.ind) -
+             static_cast<difference_type>(rhs.ind);
     };
 
     friend bool operator==(const const_iterator& lhs,
@@ -195,10 +292,25 @@ class VectorOfOptional {
     const VectorOfOptional& arr;
   };
 
-  VectorOfOptional() noexcept : curr_size{0}, storages{make_storages(0)} {}
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  VectorOfOptional() noexcept
+      : curr_size{0}, storages{make_storages(0, nullptr)} {}
 
-  VectorOfOptional(const VectorOfOptional& o) 
-      : storages{make_storages(o.size())} {
+  /// @param resource Where to allocate the elements and their occupancy bits
+  /// from, including on every reallocation. nullptr means std::aligned_alloc.
+  /// It must outlive the vector.
+  explicit VectorOfOptional(std::pmr::memory_resource* resource)
+      : curr_size{0}, storages{make_storages(0, resource)} {}
+
+  /// @brief Copies from o, with the default (std::aligned_alloc) allocation,
+  /// like std::pmr containers
+  VectorOfOptional(const VectorOfOptional& o) : VectorOfOptional(o, nullptr) {}
+
+  VectorOfOptional(const VectorOfOptional& o,
+                   std::pmr::memory_resource* resource)
+      : storages{make_storages(o.size(), resource)} {
+    occupancy_summary.assign(storages.template get<BITS_STORE_IND>());
     resize(o.size());
     for (size_t i = 0; i < o.size(); ++i) {
       if (const auto* v = o[i]) {
@@ -209,21 +321,29 @@ class VectorOfOptional {
     }
   };
 
-  VectorOfOptional(VectorOfOptional&& o)  : storages{make_storages(0)} {
+  VectorOfOptional(VectorOfOptional&& o)
+      : storages{make_storages(0, nullptr)} {
     using std::swap;
     swap(o.storages, storages);
+    swap(o.occupancy_summary, occupancy_summary);
     swap(o.curr_size, curr_size);
   }
 
-  VectorOfOptional& operator=(const VectorOfOptional& o) noexcept {
+  VectorOfOptional& operator=(const VectorOfOptional& o) {
     if (&o != this) {
-      clear();
-      copy_to_empty_arr(o.storages, storages);
+      // Keep allocating from this vector's resource
+      *this = VectorOfOptional{o, get_memory_resource()};
     }
     return *this;
   }
 
-  VectorOfOptional& operator=(VectorOfOptional&& o) noexcept = default;
+  VectorOfOptional& operator=(VectorOfOptional&& o) noexcept {
+    using std::swap;
+    swap(o.storages, storages);
+    swap(o.occupancy_summary, occupancy_summary);
+    swap(o.curr_size, curr_size);
+    return *this;
+  }
 
   ~VectorOfOptional() { destroy_arr_elements(storages); };
 
@@ -290,7 +410,15 @@ class VectorOfOptional {
     const auto s = size();
     if (s == pos) return emplace_back(std::forward<Args>(args)...);
 
-    if (s + 1 <= capacity()) {
+    if constexpr (is_trivially_relocatable_v<T>) {
+      // Open the hole with a memmove, reallocating first if needed
+      maybe_reallocate_and_copy(s + 1);
+      std::memmove(static_cast<void*>(data() + pos + 1), data() + pos,
+                   (s - pos) * sizeof(T));
+      auto words = storages.template get<BITS_STORE_IND>();
+      shift_bits_up(words, pos, s);
+      occupancy_summary.refresh(words, pos / WORD_BITS, s / WORD_BITS + 1);
+    } else if (s + 1 <= capacity()) {
       // If we don't need to reallocate, we can just move the data behind the
       // new object
       for (size_t i = s; i > pos; --i) {
@@ -304,7 +432,8 @@ class VectorOfOptional {
     } else {
       // We need to reallocate.
       // Copy the data to the new storage, with a hole for the new object
-      auto tmp_storages = make_storages(exp_reallocation_size(s + 1));
+      auto tmp_storages =
+          make_storages(exp_reallocation_size(s + 1), get_memory_resource());
 
       auto to_data_range = tmp_storages.template get<DATA_STORE_IND>();
       auto from_data_range = storages.template get<DATA_STORE_IND>();
@@ -324,6 +453,7 @@ class VectorOfOptional {
 
       using std::swap;
       swap(storages, tmp_storages);
+      occupancy_summary.assign(storages.template get<BITS_STORE_IND>());
       destroy_arr_elements(tmp_storages);
     }
 
@@ -349,18 +479,29 @@ class VectorOfOptional {
 
   void resize(size_t s) {
     if (s < size()) {
-      for (size_t i = s; i < size(); ++i) {
-        reset(i);
-      }
+      for_each_set_bit(storages.template get<BITS_STORE_IND>(), s, size(),
+                       [&](size_t i) {
+                         reset_bit(i);
+                         std::destroy_at(data() + i);
+                       });
       curr_size = s;
     } else if (s > size()) {
-      maybe_reallocate_and_copy_exact(s);
+      reserve(s);
       curr_size = s;
     }
   }
 
   void erase(size_t pos) {
     reset(pos);
+    if constexpr (is_trivially_relocatable_v<T>) {
+      std::memmove(static_cast<void*>(data() + pos), data() + pos + 1,
+                   (size() - pos - 1) * sizeof(T));
+      auto words = storages.template get<BITS_STORE_IND>();
+      shift_bits_down(words, pos, size());
+      occupancy_summary.refresh(words, pos / WORD_BITS, word_count(size()));
+      --curr_size;
+      return;
+    }
     for (size_t i = pos + 1; i < size(); ++i) {
       if (is_set(i)) {
         emplace_at(i - 1, std::move(*(data() + i)));
@@ -369,22 +510,172 @@ class VectorOfOptional {
         reset(i - 1);
       }
     }
-    reset_bit(size());
     --curr_size;
   }
 
-  void clear() {
-    for (size_t i = 0; i < size(); ++i) {
-      clear(i);
-    }
-    curr_size = 0;
-  }
+  void clear() { resize(0); }
 
   void reserve(size_t s) {
     if (capacity() >= s) return;
     maybe_reallocate_and_copy_exact(s);
   }
 
+  /// @brief Moves every element to the front, keeping their order, and
+  /// shrinks the capacity to fit them
+  /// @param remap Filled with each old slot's new index, or npos for slots
+  /// that were empty
+  /// @note Like reserve(), it moves the elements even if that may throw. If
+  /// a move throws, every element is still in its old slot, but those moved
+  /// before the throw are left moved-from, and remap is left empty.
+  void compact(std::vector<size_t>& remap) {
+    remap.assign(size(), npos);
+    const auto n = count();
+    auto tmp_storages = make_storages(n, get_memory_resource());
+    auto* to = tmp_storages.template get<DATA_STORE_IND>().begin();
+
+    size_t j = 0;
+    if constexpr (is_trivially_relocatable_v<T>) {
+      // memcpy each run of consecutive elements
+      size_t run_begin = 0;
+      size_t run_len = 0;
+      const auto flush = [&] {
+        if (run_len == 0) return;
+        std::memcpy(static_cast<void*>(to + j - run_len), data() + run_begin,
+                    run_len * sizeof(T));
+      };
+      for_each_set_index([&](size_t i) {
+        if (run_len != 0 && run_begin + run_len != i) {
+          flush();
+          run_len = 0;
+        }
+        if (run_len == 0) run_begin = i;
+        ++run_len;
+        remap[i] = j++;
+      });
+      flush();
+      // Relocated, so the old slots mustn't be destroyed
+      auto words = storages.template get<BITS_STORE_IND>();
+      std::fill(words.begin(), words.end(), word_type{0});
+    } else {
+      try {
+        for_each_set_index([&](size_t i) {
+          new (to + j) T(std::move(data()[i]));
+          remap[i] = j++;
+        });
+      } catch (...) {
+        // The new storage's bits are still clear, so destroying it wouldn't
+        // destroy the elements constructed in it
+        std::destroy_n(to, j);
+        remap.clear();
+        throw;
+      }
+    }
+
+    // The elements are now the first n slots
+    auto to_words = tmp_storages.template get<BITS_STORE_IND>();
+    std::fill_n(to_words.begin(), n / WORD_BITS, ~word_type{0});
+    if (n % WORD_BITS != 0) {
+      to_words[n / WORD_BITS] = ~(~word_type{0} << (n % WORD_BITS));
+    }
+
+    using std::swap;
+    swap(storages, tmp_storages);
+    occupancy_summary.assign(storages.template get<BITS_STORE_IND>());
+    destroy_arr_elements(tmp_storages);
+    curr_size = n;
+  }
+
+  /// @brief Moves every element to the front, keeping their order, and
+  /// shrinks the capacity to fit them
+  /// @return Each old slot's new index, or npos for slots that were empty
+  std::vector<size_t> compact() {
+    std::vector<size_t> remap;
+    compact(remap);
+    return remap;
+  }
+
+  /// @brief The number of slots holding a value
+  [[nodiscard]] size_t count() const {
+    const auto words = storages.template get<BITS_STORE_IND>();
+    size_t retval = 0;
+    for (size_t w = 0; w < word_count(size()); ++w) {
+      retval += static_cast<size_t>(popcount(words[w]));
+    }
+    return retval;
+  }
+
+  /// @brief The first slot at or after pos that holds a value
+  /// @return The slot's index, or size() if there is none
+  [[nodiscard]] size_t next_set(size_t pos) const {
+    if (pos >= size()) return size();
+    const auto words = storages.template get<BITS_STORE_IND>();
+    auto w = pos / WORD_BITS;
+    auto bits = words[w] & (~word_type{0} << (pos % WORD_BITS));
+    if (bits == 0) {
+      const auto n_words = word_count(size());
+      w = occupancy_summary.next_word(words, w + 1, n_words);
+      if (w == n_words) return size();
+      bits = words[w];
+    }
+    return w * WORD_BITS + static_cast<size_t>(countr_zero(bits));
+  }
+
+  /// @brief The first slot that holds a value
+  /// @return The slot's index, or size() if there is none
+  [[nodiscard]] size_t first_set() const { return next_set(0); }
+
+  /// @brief The last slot before pos that holds a value
+  /// @return The slot's index, or npos if there is none
+  [[nodiscard]] size_t prev_set(size_t pos) const {
+    pos = std::min(pos, size());
+    if (pos == 0) return npos;
+    const auto words = storages.template get<BITS_STORE_IND>();
+    auto w = (pos - 1) / WORD_BITS;
+    auto bits =
+        words[w] & (~word_type{0} >> (WORD_BITS - 1 - (pos - 1) % WORD_BITS));
+    if (bits == 0) {
+      const auto prev = occupancy_summary.prev_word(words, w);
+      if (prev == w) return npos;
+      w = prev;
+      bits = words[w];
+    }
+    return w * WORD_BITS + WORD_BITS - 1 -
+           static_cast<size_t>(countl_zero(bits));
+  }
+
+  /// @brief Calls f(index, value) for each slot holding a value, in order
+  template <typename F>
+  void for_each_set(F&& f) {
+    for_each_set_index([&](size_t i) { f(i, *(data() + i)); });
+  }
+
+  template <typename F>
+  void for_each_set(F&& f) const {
+    const auto* d = const_cast<VectorOfOptional*>(this)->data();
+    for_each_set_index([&](size_t i) { f(i, d[i]); });
+  }
+
+  /// @brief Calls f(index, value) for each slot in [first, last) holding a
+  /// value, in order
+  template <typename F>
+  void for_each_set(size_t first, size_t last, F&& f) {
+    for_each_set_bit(storages.template get<BITS_STORE_IND>(), first, last,
+                     [&](size_t i) { f(i, *(data() + i)); });
+  }
+
+  template <typename F>
+  void for_each_set(size_t first, size_t last, F&& f) const {
+    const auto* d = const_cast<VectorOfOptional*>(this)->data();
+    for_each_set_bit(storages.template get<BITS_STORE_IND>(), first, last,
+                     [&](size_t i) { f(i, d[i]); });
+  }
+
+  /// @brief The resource this vector allocates from, or nullptr for
+  /// std::aligned_alloc
+  [[nodiscard]] std::pmr::memory_resource* get_memory_resource() const {
+    return storages.get_memory_resource();
+  }
+
   [[nodiscard]] size_t size() const { return curr_size; }
   [[nodiscard]] size_t capacity() const {
     return storages.template get<DATA_STORE_IND>().size();
@@ -393,4 +684,264 @@ class VectorOfOptional {
   const_iterator end() const { return const_iterator(size(), *this); }
 };
 
+/// @brief A VectorOfOptional for types with an optional_niche. Presence is
+/// stored in the value itself, so there are no occupancy bits to allocate or
+/// load, and every slot always holds a T (possibly the empty value).
+/// @note The API is the same. Scans for set slots compare values one by one,
+/// so Summary is ignored.
+template <typename T, typename Summary>
+class VectorOfOptional<T, Summary, std::enable_if_t<has_optional_niche_v<T>>> {
+ protected:
+  using niche = optional_niche<T>;
+
+  std::pmr::vector<T> values;
+
+  bool is_set(size_t i) const { return !niche::is_empty(values[i]); }
+
+ public:
+  struct const_iterator {
+    using iterator_category = std::random_access_iterator_tag;
+    using difference_type = std::ptrdiff_t;
+    using value_type = const T*;
+    using pointer = const T*;
+    using reference = const T*;
+
+    const_iterator(size_t index, const VectorOfOptional& v)
+        : ind(index), arr(&v) {}
+
+    reference operator*() const { return (*arr)[ind]; }
+    pointer operator->() const { return (*arr)[ind]; }
+
+    const_iterator& operator++() {
+      ++ind;
+      return *this;
+    }
+    const_iterator operator++(int) {
+      auto retval = *this;
+      ++*this;
+      return retval;
+    }
+    const_iterator& operator--() {
+      --ind;
+      return *this;
+    }
+    const_iterator operator--(int) {
+      auto retval = *this;
+      --*this;
+      return retval;
+    }
+    const_iterator& operator+=(difference_type diff) {
+      ind += static_cast<size_t>(diff);
+      return *this;
+    }
+    const_iterator& operator-=(difference_type diff) { return *this += -diff; }
+
+    friend const_iterator operator+(const const_iterator& lhs,
+                                    difference_type rhs) {
+      auto retval = lhs;
+      retval += rhs;
+      return retval;
+    }
+
+    friend const_iterator operator-(const const_iterator& lhs,
+                                    difference_type rhs) {
+      auto retval = lhs;
+      retval -= rhs;
+      return retval;
+    }
+
+    friend difference_type operator-(const const_iterator& lhs,
+                                     const const_iterator& rhs) {
+      return static_cast<difference_type>(lhs.ind) -
+             static_cast<difference_type>(rhs.ind);
+    };
+
+    friend bool operator==(const const_iterator& lhs,
+                           const const_iterator& rhs) {
+      return lhs.ind == rhs.ind && lhs.arr == rhs.arr;
+    };
+
+    friend bool operator!=(const const_iterator& lhs,
+                           const const_iterator& rhs) {
+      return !(lhs == rhs);
+    };
+
+   private:
+    size_t ind;
+    const VectorOfOptional* arr;
+  };
+
+  static constexpr size_t npos = static_cast<size_t>(-1);
+
+  VectorOfOptional() : VectorOfOptional(nullptr) {}
+
+  /// @param resource Where to allocate from. nullptr means
+  /// std::pmr::new_delete_resource(). It must outlive the vector.
+  explicit VectorOfOptional(std::pmr::memory_resource* resource)
+      : values(resource ? resource : std::pmr::new_delete_resource()) {}
+
+  VectorOfOptional(const VectorOfOptional& o) : VectorOfOptional(o, nullptr) {}
+
+  VectorOfOptional(const VectorOfOptional& o,
+                   std::pmr::memory_resource* resource)
+      : values(o.values,
+               resource ? resource : std::pmr::new_delete_resource()) {}
+
+  VectorOfOptional(VectorOfOptional&& o) = default;
+
+  VectorOfOptional& operator=(const VectorOfOptional& o) = default;
+  VectorOfOptional& operator=(VectorOfOptional&& o) = default;
+
+  [[nodiscard]] friend bool operator==(const VectorOfOptional& lhs,
+                                       const VectorOfOptional& rhs) {
+    if (lhs.size() != rhs.size()) return false;
+    for (size_t i = 0; i < lhs.size(); ++i) {
+      const auto* l = lhs[i];
+      const auto* r = rhs[i];
+      if ((l == nullptr) != (r == nullptr) || (l && !(*l == *r))) {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  [[nodiscard]] friend bool operator!=(const VectorOfOptional& lhs,
+                                       const VectorOfOptional& rhs) {
+    return !(lhs == rhs);
+  }
+
+  [[nodiscard]] T* operator[](size_t pos) {
+    return is_set(pos) ? &values[pos] : nullptr;
+  }
+
+  [[nodiscard]] const T* operator[](size_t pos) const {
+    return is_set(pos) ? &values[pos] : nullptr;
+  }
+
+  T* push_back(const T& arg) { return emplace_back(arg); }
+
+  T* push_back(T&& arg) { return emplace_back(std::move(arg)); }
+
+  template <typename... Args>
+  T* emplace_back(Args&&... args) {
+    values.emplace_back(std::forward<Args>(args)...);
+    return operator[](size() - 1);
+  }
+
+  T* emplace_back(std::nullopt_t) {
+    values.push_back(niche::empty_value());
+    return nullptr;
+  }
+
+  template <typename... Args>
+  T* emplace_at(size_t pos, Args&&... args) {
+    values[pos] = T(std::forward<Args>(args)...);
+    return operator[](pos);
+  }
+
+  T* emplace_at(size_t pos, std::nullopt_t) {
+    reset(pos);
+    return nullptr;
+  }
+
+  template <typename... Args>
+  T* emplace(size_t pos, Args&&... args) {
+    values.emplace(values.begin() + static_cast<std::ptrdiff_t>(pos),
+                   std::forward<Args>(args)...);
+    return operator[](pos);
+  }
+
+  void fill(const T& t) { std::fill(values.begin(), values.end(), t); }
+
+  void fill(std::nullopt_t) { fill(niche::empty_value()); }
+
+  void reset(size_t pos) { values[pos] = niche::empty_value(); }
+
+  void resize(size_t s) { values.resize(s, niche::empty_value()); }
+
+  void erase(size_t pos) {
+    values.erase(values.begin() + static_cast<std::ptrdiff_t>(pos));
+  }
+
+  void clear() { values.clear(); }
+
+  void compact(std::vector<size_t>& remap) {
+    remap.assign(size(), npos);
+    size_t j = 0;
+    for (size_t i = 0; i < size(); ++i) {
+      if (is_set(i)) {
+        if (i != j) values[j] = std::move(values[i]);
+        remap[i] = j++;
+      }
+    }
+    values.resize(j);
+    values.shrink_to_fit();
+  }
+
+  std::vector<size_t> compact() {
+    std::vector<size_t> remap;
+    compact(remap);
+    return remap;
+  }
+
+  void reserve(size_t s) { values.reserve(s); }
+
+  [[nodiscard]] size_t count() const {
+    return static_cast<size_t>(
+        std::count_if(values.begin(), values.end(),
+                      [](const T& t) { return !niche::is_empty(t); }));
+  }
+
+  [[nodiscard]] size_t next_set(size_t pos) const {
+    while (pos < size() && !is_set(pos)) ++pos;
+    return std::min(pos, size());
+  }
+
+  [[nodiscard]] size_t first_set() const { return next_set(0); }
+
+  [[nodiscard]] size_t prev_set(size_t pos) const {
+    for (pos = std::min(pos, size()); pos > 0; --pos) {
+      if (is_set(pos - 1)) return pos - 1;
+    }
+    return npos;
+  }
+
+  template <typename F>
+  void for_each_set(F&& f) {
+    for (size_t i = 0; i < size(); ++i) {
+      if (is_set(i)) f(i, values[i]);
+    }
+  }
+
+  template <typename F>
+  void for_each_set(F&& f) const {
+    for (size_t i = 0; i < size(); ++i) {
+      if (is_set(i)) f(i, values[i]);
+    }
+  }
+
+  template <typename F>
+  void for_each_set(size_t first, size_t last, F&& f) {
+    for (auto i = first; i < last; ++i) {
+      if (is_set(i)) f(i, values[i]);
+    }
+  }
+
+  template <typename F>
+  void for_each_set(size_t first, size_t last, F&& f) const {
+    for (auto i = first; i < last; ++i) {
+      if (is_set(i)) f(i, values[i]);
+    }
+  }
+
+  [[nodiscard]] std::pmr::memory_resource* get_memory_resource() const {
+    return values.get_allocator().resource();
+  }
+
+  [[nodiscard]] size_t size() const { return values.size(); }
+  [[nodiscard]] size_t capacity() const { return values.capacity(); }
+  const_iterator begin() const { return const_iterator(0, *this); }
+  const_iterator end() const { return const_iterator(size(), *this); }
+};
+
 }  // namespace misc
@@ -0,0 +1,172 @@
+#include <addressable_minmax_heap.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <functional>
+#include <map>
+#include <set>
+#include <string>
+#include <vector>
+
+using namespace misc;
+
+class AddressableMinMaxHeapFixture : public addressable_minmax_heap<size_t>,
+                                     public testing::Test {
+ public:
+  bool is_heap() const {
+    std::vector<size_t> values;
+    for (const auto& node : m_heap) {
+      values.push_back(node.value);
+    }
+    return is_minmax_heap(values.begin(), values.end());
+  }
+
+  bool positions_match() const {
+    for (size_t i = 0; i < m_heap.size(); ++i) {
+      if (*m_heap[i].position != i + 1) return false;
+    }
+    return true;
+  }
+};
+
+TEST_F(AddressableMinMaxHeapFixture, push_pop) {
+  for (size_t i = 16; i > 0; --i) {
+    const auto h = push(i);
+    EXPECT_EQ((*this)[h], i);
+    EXPECT_TRUE(is_heap());
+    EXPECT_TRUE(positions_match());
+  }
+  EXPECT_EQ(front(), 1);
+  EXPECT_EQ(back(), 16);
+  EXPECT_EQ((*this)[front_handle()], 1);
+  EXPECT_EQ((*this)[back_handle()], 16);
+
+  pop_front();
+  pop_back();
+  EXPECT_EQ(size(), 14);
+  EXPECT_EQ(front(), 2);
+  EXPECT_EQ(back(), 15);
+  EXPECT_TRUE(is_heap());
+  EXPECT_TRUE(positions_match());
+}
+
+TEST_F(AddressableMinMaxHeapFixture, erase) {
+  std::vector<handle> handles;
+  for (size_t i = 0; i < 20; ++i) {
+    handles.push_back(push(i));
+  }
+
+  // Erase from a mix of min and max levels, and the last element
+  for (size_t i : std::initializer_list<size_t>{19, 0, 7, 12, 3, 18}) {
+    erase(handles[i]);
+    EXPECT_TRUE(is_heap());
+    EXPECT_TRUE(positions_match());
+  }
+  EXPECT_EQ(size(), 14);
+  EXPECT_EQ(front(), 1);
+  EXPECT_EQ(back(), 17);
+
+  // The remaining handles still refer to their elements
+  for (size_t i : std::initializer_list<size_t>{1, 2, 4, 5, 6, 8, 9, 10, 11,
+                                                13, 14, 15, 16, 17}) {
+    EXPECT_EQ((*this)[handles[i]], i);
+  }
+
+  // Slots are reused
+  const auto h = push(100);
+  EXPECT_EQ((*this)[h], 100);
+  EXPECT_EQ(back(), 100);
+}
+
+TEST_F(AddressableMinMaxHeapFixture, decrease_increase) {
+  std::vector<handle> handles;
+  for (size_t i = 0; i < 32; ++i) {
+    handles.push_back(push(100 + i));
+  }
+
+  decrease(handles[20], 1);
+  EXPECT_EQ(front(), 1);
+  EXPECT_EQ(front_handle(), handles[20]);
+  EXPECT_TRUE(is_heap());
+  EXPECT_TRUE(positions_match());
+
+  increase(handles[5], 1000);
+  EXPECT_EQ(back(), 1000);
+  EXPECT_EQ(back_handle(), handles[5]);
+  EXPECT_TRUE(is_heap());
+  EXPECT_TRUE(positions_match());
+
+  // Decrease the max, and increase the min
+  decrease(back_handle(), 0);
+  EXPECT_EQ(front(), 0);
+  EXPECT_EQ(back(), 131);
+  increase(handles[20], 500);
+  EXPECT_EQ(back(), 500);
+  EXPECT_TRUE(is_heap());
+  EXPECT_TRUE(positions_match());
+}
+
+TEST_F(AddressableMinMaxHeapFixture, update_matches_multiset) {
+  std::map<size_t, handle> handles;
+  std::multiset<size_t> expected;
+  size_t v = 3;
+  const auto next = [&] {
+    v = (v * 1103515245 + 12345) % 1000;
+    return v;
+  };
+
+  for (size_t id = 0; id < 200; ++id) {
+    const auto value = next();
+    handles[id] = push(value);
+    expected.insert(value);
+  }
+
+  for (size_t round = 0; round < 400; ++round) {
+    auto it = handles.begin();
+    std::advance(it, static_cast<long>(next() % handles.size()));
+    const auto old_value = (*this)[it->second];
+    expected.erase(expected.find(old_value));
+    if (round % 3 == 0) {
+      erase(it->second);
+      handles.erase(it);
+      const auto value = next();
+      handles[200 + round] = push(value);
+      expected.insert(value);
+    } else {
+      const auto value = next();
+      update(it->second, value);
+      expected.insert(value);
+    }
+    ASSERT_TRUE(is_heap());
+    ASSERT_TRUE(positions_match());
+    ASSERT_EQ(front(), *expected.begin());
+    ASSERT_EQ(back(), *expected.rbegin());
+  }
+}
+
+TEST(AddressableMinMaxHeap, move) {
+  addressable_minmax_heap<size_t, std::greater<>> heap;
+  const auto h = heap.push(5);
+  heap.push(10);
+  auto moved = std::move(heap);
+  EXPECT_EQ(moved.front(), 10);
+  // "decrease" follows the comparator, so this moves it to the front
+  moved.decrease(h, 20);
+  EXPECT_EQ(moved.front(), 20);
+  EXPECT_EQ(moved.back(), 10);
+}
+
+TEST(AddressableMinMaxHeap, pop_value) {
+  addressable_minmax_heap<std::string> heap;
+  for (const auto* s : {"delta", "alpha", "echo", "charlie", "bravo"}) {
+    heap.push(s);
+  }
+  EXPECT_EQ(heap.pop_front_value(), "alpha");
+  EXPECT_EQ(heap.pop_back_value(), "echo");
+  EXPECT_EQ(heap.pop_back_value(), "delta");
+  const auto h = heap.push("foxtrot");
+  EXPECT_EQ(heap[h], "foxtrot");
+  EXPECT_EQ(heap.front(), "bravo");
+  EXPECT_EQ(heap.back(), "foxtrot");
+  EXPECT_EQ(heap.size(), 3);
+}
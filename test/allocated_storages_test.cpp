@@ -4,10 +4,13 @@
 
 #include <algorithm>
 #include <cstddef>
+#include <cstdint>
 #include <exception>
 #include <iterator>
 #include <memory>
 
+#include "test.h"
+
 namespace {
 template <size_t ID, size_t OnConstruction, size_t OnCopy, size_t OnDestroy>
 struct Thrower {
@@ -149,3 +152,20 @@ TEST(unique_arrays, move) {
   arrs2.reset();
   EXPECT_EQ(copy_int_ptr.use_count(), 1);
 }
+
+TEST(memory_resource, allocated_storages) {
+  CountingResource resource;
+  {
+    misc::allocated_storages<char, size_t> arr(&resource, 3, 2);
+    EXPECT_EQ(arr.get_memory_resource(), &resource);
+    EXPECT_EQ(resource.allocations, 1);
+    EXPECT_EQ(resource.live_bytes, 8 + 2 * sizeof(size_t));
+    EXPECT_EQ(reinterpret_cast<std::uintptr_t>(arr.get<1>().begin()) %
+                  alignof(size_t),
+              0);
+  }
+  EXPECT_EQ(resource.live_bytes, 0);
+
+  misc::allocated_storages<char, size_t> heap(3, 2);
+  EXPECT_EQ(heap.get_memory_resource(), nullptr);
+}
@@ -0,0 +1,21 @@
+#include <bit_scan.h>
+#include <gtest/gtest.h>
+
+#include <cstdint>
+
+TEST(BitScan, Singles) {
+  for (int i = 0; i < 64; ++i) {
+    const auto word = uint64_t{1} << i;
+    EXPECT_EQ(misc::countr_zero(word), i);
+    EXPECT_EQ(misc::countl_zero(word), 63 - i);
+    EXPECT_EQ(misc::popcount(word), 1);
+  }
+}
+
+TEST(BitScan, Multiple) {
+  EXPECT_EQ(misc::countr_zero(0b1011000), 3);
+  EXPECT_EQ(misc::countl_zero(0b1011000), 57);
+  EXPECT_EQ(misc::popcount(0b1011000), 3);
+  EXPECT_EQ(misc::popcount(~uint64_t{0}), 64);
+  EXPECT_EQ(misc::popcount(0), 0);
+}
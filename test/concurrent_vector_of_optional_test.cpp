@@ -0,0 +1,86 @@
+#include <concurrent_vector_of_optional.h>
+#include <gtest/gtest.h>
+#include <parallel_for.h>
+
+#include <atomic>
+#include <cstddef>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using misc::concurrent_vector_of_optional;
+
+TEST(ConcurrentVectorOfOptional, Basic) {
+  concurrent_vector_of_optional<std::string> v(100);
+  EXPECT_EQ(v.size(), 100);
+  EXPECT_EQ(v[3], nullptr);
+
+  const auto* s = v.try_emplace_at(3, "three");
+  ASSERT_NE(s, nullptr);
+  EXPECT_EQ(*s, "three");
+  EXPECT_EQ(v[3], s);
+  EXPECT_EQ(v.try_emplace_at(3, "again"), nullptr);
+  EXPECT_EQ(*v[3], "three");
+
+  v.try_emplace_at(70, "seventy");
+  EXPECT_EQ(v.count(), 2);
+  EXPECT_EQ(v.next_set(4), 70);
+
+  v.reset(3);
+  EXPECT_EQ(v[3], nullptr);
+  EXPECT_NE(v.try_emplace_at(3, "new"), nullptr);
+
+  v.resize(200);
+  EXPECT_EQ(v.size(), 200);
+  EXPECT_EQ(*v[3], "new");
+  EXPECT_EQ(*v[70], "seventy");
+  v.resize(50);
+  EXPECT_EQ(v.count(), 1);
+}
+
+TEST(ConcurrentVectorOfOptional, ConcurrentClaims) {
+  constexpr size_t slots = 10'000;
+  constexpr size_t threads = 4;
+  concurrent_vector_of_optional<size_t> v(slots);
+  std::vector<std::atomic<size_t>> wins(threads);
+
+  // Every thread tries to claim every slot, starting at different places
+  misc::parallel_for(threads, threads, [&](size_t first, size_t last) {
+    for (auto t = first; t < last; ++t) {
+      for (size_t n = 0; n < slots; ++n) {
+        const auto i = (n + t * slots / threads) % slots;
+        if (v.try_emplace_at(i, t)) {
+          wins[t].fetch_add(1, std::memory_order_relaxed);
+        }
+      }
+    }
+  });
+
+  size_t total = 0;
+  for (const auto& w : wins) {
+    total += w.load();
+  }
+  EXPECT_EQ(total, slots);
+  EXPECT_EQ(v.count(), slots);
+
+  std::vector<size_t> per_thread(threads);
+  v.for_each_set([&](size_t, size_t t) { ++per_thread[t]; });
+  for (size_t t = 0; t < threads; ++t) {
+    EXPECT_EQ(per_thread[t], wins[t].load());
+  }
+}
+
+using ConcurrentVectorOfOptionalCountingFixture = SpecMemberCountingFixture;
+
+TEST_F(ConcurrentVectorOfOptionalCountingFixture, Destroy) {
+  {
+    concurrent_vector_of_optional<TestElement> v(10);
+    v.try_emplace_at(1);
+    v.try_emplace_at(1);
+    v.try_emplace_at(9);
+    EXPECT_EQ(call_counts.constructor_calls, 2);
+    v.resize(20);
+  }
+  EXPECT_EQ(call_counts.destructor_calls, call_counts.constructor_calls);
+}
@@ -3,8 +3,21 @@
 #include <gtest/gtest.h>
 
 #include <algorithm>
+#include <cstdint>
+#include <functional>
 #include <memory>
 #include <string>
+#include <utility>
+#include <vector>
+
+namespace {
+enum class Slot : uint32_t {};
+enum class Color : uint8_t { red, green, blue };
+}  // namespace
+
+template <>
+struct misc::optional_niche<Slot>
+    : misc::sentinel_niche<Slot, Slot{~uint32_t{0}}> {};
 
 TEST(DenseDynamicIndexMap, ConstructDefault) {
   misc::dense_dynamic_index_map<size_t, size_t> m;
@@ -99,7 +112,7 @@ TEST_F(DenseDynamicIndexMapFixture, ReassignElement) {
 TEST_F(DenseDynamicIndexMapFixture, Erase) {
   auto it = find(2);
   auto next_it = erase(it);
-  ASSERT_NE(next_it, find(5));
+  ASSERT_EQ(next_it, find(5));
   ASSERT_EQ(find(2), end());
 
   auto again_it = erase(it);
@@ -125,4 +138,130 @@ TEST_F(DenseDynamicIndexMapFixture, ReverseIterate) {
                  });
   using namespace ::testing;
   ASSERT_THAT(v, ElementsAre(Pair(5, 5), Pair(2, 2), Pair(1, 1)));
-}
\ No newline at end of file
+}
+
+TEST(DenseDynamicIndexMap, NicheValues) {
+  misc::dense_dynamic_index_map<size_t, Slot> m;
+  m.emplace(3, Slot{30});
+  m[7] = Slot{70};
+  ASSERT_NE(m.find(3), m.end());
+  EXPECT_EQ(m.find(3)->second, Slot{30});
+  EXPECT_EQ(m.find(5), m.end());
+
+  std::vector<size_t> keys;
+  for (const auto& [key, value] : m) {
+    keys.push_back(key);
+  }
+  EXPECT_EQ(keys, (std::vector<size_t>{3, 7}));
+}
+
+TEST(DenseDynamicIndexMap, EmplacePastTheEnd) {
+  misc::dense_dynamic_index_map<size_t, std::string> m;
+  m.emplace(100'000, "far");
+  m[3] = "near";
+  EXPECT_EQ(m.find(100'000)->second, "far");
+  EXPECT_EQ(std::next(m.begin()), m.find(100'000));
+}
+
+TEST_F(DenseDynamicIndexMapFixture, EraseKeepsOtherSlots) {
+  const auto* five = find(5)->second.get();
+  erase(find(1));
+  ASSERT_EQ(find(1), end());
+  ASSERT_NE(find(2), end());
+  ASSERT_EQ(find(5)->second.get(), five);
+  ASSERT_EQ(begin(), find(2));
+}
+
+TEST_F(DenseDynamicIndexMapFixture, Trim) {
+  erase(find(5));
+  ASSERT_EQ(std::prev(end()), find(2));
+  trim();
+  ASSERT_EQ(std::prev(end()), find(2));
+  ASSERT_EQ(std::next(find(2)), end());
+  emplace(9, new int{9});
+  ASSERT_EQ(std::next(find(2)), find(9));
+
+  erase(find(1));
+  erase(find(2));
+  erase(find(9));
+  trim();
+  ASSERT_EQ(begin(), end());
+}
+
+TEST(DenseDynamicIndexMap, EraseAndTrimSizeKeys) {
+  misc::dense_dynamic_index_map<size_t, size_t> m;
+  m[1] = 10;
+  m[4] = 40;
+  m[6] = 60;
+  const auto next = m.erase(m.find(4));
+  ASSERT_EQ(next, m.find(6));
+  ASSERT_EQ(m.find(6)->second, 60);
+  m.erase(m.find(6));
+  m.trim();
+  ASSERT_EQ(std::next(m.begin()), m.end());
+  ASSERT_EQ(m.begin()->second, 10);
+}
+
+TEST(DenseDynamicIndexMap, InvertibleKeyToIndexMap) {
+  misc::dense_dynamic_index_map<Color, std::string, misc::cast_to<size_t>,
+                                misc::cast_to<Color>>
+      m;
+  m[Color::blue] = "blue";
+  m.emplace(Color::red, "red");
+  ASSERT_NE(m.find(Color::red), m.end());
+  EXPECT_EQ(m.find(Color::red)->first, Color::red);
+  EXPECT_EQ(m.find(Color::green), m.end());
+
+  std::vector<std::pair<Color, std::string>> v;
+  for (const auto& [key, value] : std::as_const(m)) {
+    v.emplace_back(key, value);
+  }
+  using namespace ::testing;
+  EXPECT_THAT(v,
+              ElementsAre(Pair(Color::red, "red"), Pair(Color::blue, "blue")));
+
+  (*m.begin()).second = "crimson";
+  EXPECT_EQ(m.find(Color::red)->second, "crimson");
+  m.erase(m.find(Color::red));
+  EXPECT_EQ(m.begin()->first, Color::blue);
+}
+
+TEST(DenseDynamicIndexMap, ParallelForEachAndReduce) {
+  misc::dense_dynamic_index_map<size_t, size_t> m;
+  constexpr size_t n = 100'000;
+  for (size_t i = 0; i < n; i += 3) {
+    m[i] = i;
+  }
+  for (const size_t threads : {size_t{1}, size_t{4}}) {
+    m.parallel_for_each([](size_t key, size_t& value) { value = key + 1; },
+                        threads);
+    const auto sum = m.parallel_reduce(
+        size_t{0}, std::plus<>{},
+        [](size_t, const size_t& value) { return value; }, threads);
+    size_t expected = 0;
+    for (size_t i = 0; i < n; i += 3) {
+      expected += i + 1;
+    }
+    EXPECT_EQ(sum, expected);
+  }
+
+  // Partial results are combined in key order
+  misc::dense_dynamic_index_map<size_t, std::string, misc::identity, void>
+      words;
+  for (size_t i = 0; i < 1000; ++i) {
+    words[i] = std::to_string(i % 10);
+  }
+  const auto concatenated = words.parallel_reduce(
+      std::string{}, std::plus<>{},
+      [](size_t, const std::string& s) { return s; }, 4);
+  std::string expected;
+  for (size_t i = 0; i < 1000; ++i) {
+    expected += std::to_string(i % 10);
+  }
+  EXPECT_EQ(concatenated, expected);
+  const misc::dense_dynamic_index_map<size_t, std::string> empty;
+  const auto identity = [](size_t, const std::string& s) { return s; };
+  EXPECT_EQ(empty.parallel_reduce(std::string{"empty"}, std::plus<>{},
+                                  identity),
+            "empty");
+}
@@ -0,0 +1,138 @@
+#include <external_minmax_heap.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <deque>
+#include <functional>
+#include <vector>
+
+using namespace misc;
+
+namespace {
+std::vector<size_t> make_values(size_t n, size_t seed) {
+  std::vector<size_t> retval;
+  for (size_t i = 0; i < n; ++i) {
+    seed = (seed * 6364136223846793005u + 1442695040888963407u);
+    retval.push_back((seed >> 33) % 1000);
+  }
+  return retval;
+}
+}  // namespace
+
+TEST(ExternalMinMaxHeap, spills_and_pops_both_ends) {
+  // Room for 16 elements in memory, and 3 elements per block
+  external_minmax_heap<size_t> heap(16 * sizeof(size_t), 3 * sizeof(size_t));
+  const auto values = make_values(500, 1);
+  for (const auto v : values) {
+    heap.push(v);
+  }
+  EXPECT_EQ(heap.size(), values.size());
+  EXPECT_GT(heap.run_count(), 1);
+
+  std::deque<size_t> expected(values.begin(), values.end());
+  std::sort(expected.begin(), expected.end());
+  bool from_front = true;
+  while (!expected.empty()) {
+    ASSERT_EQ(heap.front(), expected.front());
+    ASSERT_EQ(heap.back(), expected.back());
+    if (from_front) {
+      heap.pop_front();
+      expected.pop_front();
+    } else {
+      heap.pop_back();
+      expected.pop_back();
+    }
+    // Pop unevenly from each end, so runs are drained from both sides
+    from_front = expected.size() % 3 != 0;
+    ASSERT_EQ(heap.size(), expected.size());
+  }
+  EXPECT_TRUE(heap.empty());
+  EXPECT_EQ(heap.run_count(), 0);
+}
+
+TEST(ExternalMinMaxHeap, interleaved) {
+  external_minmax_heap<size_t, std::greater<>> heap(8 * sizeof(size_t),
+                                                    2 * sizeof(size_t));
+  std::vector<size_t> reference;
+  const auto values = make_values(400, 2);
+  for (size_t i = 0; i < values.size(); ++i) {
+    heap.push(values[i]);
+    reference.push_back(values[i]);
+    std::sort(reference.begin(), reference.end(), std::greater<>{});
+    if (i % 4 == 3) {
+      ASSERT_EQ(heap.front(), reference.front());
+      heap.pop_front();
+      reference.erase(reference.begin());
+    } else if (i % 4 == 1) {
+      ASSERT_EQ(heap.back(), reference.back());
+      heap.pop_back();
+      reference.pop_back();
+    }
+  }
+  ASSERT_EQ(heap.size(), reference.size());
+  for (const auto v : reference) {
+    ASSERT_EQ(heap.front(), v);
+    heap.pop_front();
+  }
+  EXPECT_TRUE(heap.empty());
+}
+
+TEST(ExternalMinMaxHeap, merges_runs) {
+  // Half the budget, 32 elements, for the in-memory heap, and the other half
+  // for the blocks of at most 8 runs
+  external_minmax_heap<size_t> heap(64 * sizeof(size_t), 2 * sizeof(size_t));
+  const auto values = make_values(5000, 3);
+  std::deque<size_t> expected;
+  for (size_t i = 0; i < values.size(); ++i) {
+    heap.push(values[i]);
+    expected.push_back(values[i]);
+    ASSERT_LE(heap.run_count(), 8);
+    // Merge runs that have been partly read from both ends
+    if (i == 2000) {
+      std::sort(expected.begin(), expected.end());
+      for (size_t j = 0; j < 300; ++j) {
+        ASSERT_EQ(heap.front(), expected.front());
+        heap.pop_front();
+        expected.pop_front();
+        ASSERT_EQ(heap.back(), expected.back());
+        heap.pop_back();
+        expected.pop_back();
+      }
+    }
+  }
+  EXPECT_GT(heap.run_count(), 1);
+
+  std::sort(expected.begin(), expected.end());
+  for (const auto v : expected) {
+    ASSERT_EQ(heap.front(), v);
+    heap.pop_front();
+  }
+  EXPECT_TRUE(heap.empty());
+}
+
+TEST(ExternalMinMaxHeap, alternates_within_one_block) {
+  // Each run, at most 32 elements, fits in a single 1024-element block, so
+  // both ends pop from that one block
+  external_minmax_heap<size_t> heap(64 * sizeof(size_t),
+                                    1024 * sizeof(size_t));
+  const auto values = make_values(300, 4);
+  for (const auto v : values) {
+    heap.push(v);
+  }
+  EXPECT_GT(heap.run_count(), 1);
+
+  std::deque<size_t> expected(values.begin(), values.end());
+  std::sort(expected.begin(), expected.end());
+  while (!expected.empty()) {
+    ASSERT_EQ(heap.front(), expected.front());
+    heap.pop_front();
+    expected.pop_front();
+    if (expected.empty()) break;
+    ASSERT_EQ(heap.back(), expected.back());
+    heap.pop_back();
+    expected.pop_back();
+    ASSERT_EQ(heap.size(), expected.size());
+  }
+  EXPECT_TRUE(heap.empty());
+  EXPECT_EQ(heap.run_count(), 0);
+}
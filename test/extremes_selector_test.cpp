@@ -0,0 +1,97 @@
+#include <extremes_selector.h>
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+
+#include <algorithm>
+#include <functional>
+#include <string>
+#include <vector>
+
+using namespace misc;
+
+namespace {
+std::vector<size_t> make_stream(size_t n, size_t seed) {
+  std::vector<size_t> retval;
+  for (size_t i = 0; i < n; ++i) {
+    seed = (seed * 6364136223846793005u + 1442695040888963407u);
+    retval.push_back((seed >> 33) % 10'000);
+  }
+  return retval;
+}
+}  // namespace
+
+TEST(ExtremesSelector, selects_smallest_and_largest) {
+  const auto stream = make_stream(1000, 1);
+  extremes_selector<size_t> selector(10);
+  for (const auto v : stream) {
+    selector.push(v);
+  }
+  EXPECT_EQ(selector.smallest().size(), 10);
+  EXPECT_EQ(selector.largest().size(), 10);
+
+  auto sorted = stream;
+  std::sort(sorted.begin(), sorted.end());
+  EXPECT_EQ(selector.smallest().back(), sorted[9]);
+  EXPECT_EQ(selector.largest().front(), sorted[sorted.size() - 10]);
+
+  EXPECT_EQ(selector.extract_smallest(),
+            std::vector<size_t>(sorted.begin(), sorted.begin() + 10));
+  EXPECT_EQ(selector.extract_largest(),
+            std::vector<size_t>(sorted.rbegin(), sorted.rbegin() + 10));
+}
+
+TEST(ExtremesSelector, rejects) {
+  extremes_selector<size_t> selector(2);
+  EXPECT_TRUE(selector.push(5));
+  EXPECT_TRUE(selector.push(6));
+  EXPECT_TRUE(selector.push(1));
+  EXPECT_TRUE(selector.push(9));
+  // Neither smaller than the 2 smallest, nor larger than the 2 largest
+  EXPECT_FALSE(selector.push(5));
+  EXPECT_FALSE(selector.push(6));
+  EXPECT_TRUE(selector.push(4));
+  EXPECT_TRUE(selector.push(7));
+
+  using namespace ::testing;
+  EXPECT_THAT(selector.extract_smallest(), ElementsAre(1, 4));
+  EXPECT_THAT(selector.extract_largest(), ElementsAre(9, 7));
+
+  extremes_selector<size_t> empty(0);
+  EXPECT_FALSE(empty.push(1));
+  EXPECT_TRUE(empty.smallest().empty());
+}
+
+TEST(ExtremesSelector, merge) {
+  const auto stream = make_stream(3000, 2);
+  std::vector<extremes_selector<size_t, std::greater<>>> partials(
+      3, extremes_selector<size_t, std::greater<>>(25));
+  for (size_t i = 0; i < stream.size(); ++i) {
+    partials[i % partials.size()].push(stream[i]);
+  }
+
+  extremes_selector<size_t, std::greater<>> total(25);
+  for (auto& partial : partials) {
+    total.merge(std::move(partial));
+  }
+
+  auto sorted = stream;
+  std::sort(sorted.begin(), sorted.end(), std::greater<>{});
+  EXPECT_EQ(total.extract_smallest(),
+            std::vector<size_t>(sorted.begin(), sorted.begin() + 25));
+  EXPECT_EQ(total.extract_largest(),
+            std::vector<size_t>(sorted.rbegin(), sorted.rbegin() + 25));
+}
+
+TEST(ExtremesSelector, strings) {
+  extremes_selector<std::string> selector(5);
+  for (char c = 'a'; c <= 'j'; ++c) {
+    selector.push(std::string(1, c));
+  }
+  const std::string late = "e";
+  EXPECT_FALSE(selector.push(late));
+
+  using namespace ::testing;
+  EXPECT_THAT(selector.extract_largest(), ElementsAre("j", "i", "h", "g", "f"));
+  EXPECT_THAT(selector.extract_smallest(),
+              ElementsAre("a", "b", "c", "d", "e"));
+}
@@ -0,0 +1,93 @@
+#include <gtest/gtest.h>
+#include <mapped_vector_of_optional.h>
+
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include <optional>
+#include <string>
+#include <system_error>
+#include <vector>
+
+using misc::mapped_vector_of_optional;
+
+namespace {
+struct Point {
+  int32_t x;
+  int32_t y;
+};
+
+class MappedVectorOfOptionalFixture : public testing::Test {
+ public:
+  std::string path = testing::TempDir() + "mapped_vector_of_optional_test";
+  ~MappedVectorOfOptionalFixture() override { std::remove(path.c_str()); }
+};
+}  // namespace
+
+TEST_F(MappedVectorOfOptionalFixture, CreateAndReopen) {
+  {
+    auto v = mapped_vector_of_optional<Point>::create(path);
+    EXPECT_EQ(v.size(), 0);
+    for (int32_t i = 0; i < 1000; ++i) {
+      if (i % 3 == 0) {
+        EXPECT_EQ(v.emplace_back(std::nullopt), nullptr);
+      } else {
+        v.push_back(Point{i, -i});
+      }
+    }
+    v.reset(1);
+    v.flush();
+  }
+
+  const auto v = mapped_vector_of_optional<Point>::open(path);
+  EXPECT_EQ(v.size(), 1000);
+  EXPECT_GE(v.capacity(), 1000);
+  EXPECT_EQ(v[0], nullptr);
+  EXPECT_EQ(v[1], nullptr);
+  ASSERT_NE(v[2], nullptr);
+  EXPECT_EQ(v[2]->x, 2);
+  EXPECT_EQ(v[999], nullptr);
+  ASSERT_NE(v[998], nullptr);
+  EXPECT_EQ(v[998]->y, -998);
+  EXPECT_EQ(v.count(), 1000 - 334 - 1);
+  EXPECT_EQ(v.next_set(0), 2);
+
+  std::vector<size_t> visited;
+  v.for_each_set([&](size_t i, const Point& p) {
+    EXPECT_EQ(p.x, static_cast<int32_t>(i));
+    visited.push_back(i);
+  });
+  EXPECT_EQ(visited.size(), v.count());
+}
+
+TEST_F(MappedVectorOfOptionalFixture, ResizeKeepsBitsPastSizeClear) {
+  auto v = mapped_vector_of_optional<uint64_t>::create(path, 10);
+  v.resize(10);
+  v.emplace_at(9, uint64_t{9});
+  v.resize(5);
+  v.resize(200);
+  EXPECT_EQ(v[9], nullptr);
+  EXPECT_EQ(v.count(), 0);
+  v.emplace_at(150, uint64_t{150});
+  v.clear();
+  EXPECT_EQ(v.size(), 0);
+  EXPECT_EQ(v.next_set(0), 0);
+}
+
+TEST_F(MappedVectorOfOptionalFixture, OpenWrongType) {
+  { auto v = mapped_vector_of_optional<uint64_t>::create(path, 4); }
+  EXPECT_THROW(mapped_vector_of_optional<uint8_t>::open(path),
+               std::system_error);
+  EXPECT_THROW(mapped_vector_of_optional<uint64_t>::open(path + ".missing"),
+               std::system_error);
+}
+
+TEST_F(MappedVectorOfOptionalFixture, FileStartsWithMagic) {
+  { auto v = mapped_vector_of_optional<uint64_t>::create(path); }
+  char magic[8] = {};
+  auto* f = std::fopen(path.c_str(), "rb");
+  ASSERT_NE(f, nullptr);
+  EXPECT_EQ(std::fread(magic, 1, sizeof(magic), f), sizeof(magic));
+  std::fclose(f);
+  EXPECT_EQ(std::string(magic, sizeof(magic)), std::string("mvoopt\n", 8));
+}
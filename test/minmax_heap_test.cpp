@@ -1,6 +1,9 @@
 #include <gtest/gtest.h>
 #include <minmax_heap.h>
 #include <algorithm>
+#include <numeric>
+#include <string>
+#include <vector>
 
 
 using namespace misc;
@@ -190,3 +193,326 @@ TEST_F(MinMaxHeapNoCopyFixture, copy_construct) {
   EXPECT_TRUE(std::all_of(vec.begin(), vec.end(),
                           [](const auto& cc) { return cc.copies == 1; }));
 }
+
+TEST(BlockedLayout, positions_are_unique) {
+  using layout = blocked_layout<3>;
+  for (size_t n = 1; n < 300; ++n) {
+    std::vector<bool> used(layout::storage_size(n), false);
+    for (size_t i = 1; i <= n; ++i) {
+      const auto pos = layout::position(i);
+      ASSERT_LT(pos, used.size());
+      EXPECT_FALSE(used[pos]);
+      used[pos] = true;
+    }
+    // The last slot is always used
+    EXPECT_TRUE(used.back());
+  }
+}
+
+template <typename Layout>
+class BlockedMinMaxHeapTest : public testing::Test {};
+
+template <typename Layout>
+void expect_consistent_steps() {
+  for (size_t i = 1; i < 5000; ++i) {
+    const auto pos = Layout::position(i);
+    EXPECT_EQ(Layout::child_position(pos, 0), Layout::position(2 * i));
+    EXPECT_EQ(Layout::child_position(pos, 1), Layout::position(2 * i + 1));
+    if (i > 1) {
+      EXPECT_EQ(Layout::parent_position(pos), Layout::position(i / 2));
+    }
+  }
+}
+
+TEST(BlockedLayout, steps_match_positions) {
+  expect_consistent_steps<implicit_layout>();
+  expect_consistent_steps<blocked_layout<1>>();
+  expect_consistent_steps<blocked_layout<2>>();
+  expect_consistent_steps<blocked_layout<3>>();
+  expect_consistent_steps<blocked_layout<4>>();
+}
+
+using blocked_layouts =
+    testing::Types<blocked_layout<1>, blocked_layout<2>, blocked_layout<3>>;
+TYPED_TEST_SUITE(BlockedMinMaxHeapTest, blocked_layouts);
+
+TYPED_TEST(BlockedMinMaxHeapTest, matches_sorted_sequence) {
+  minmax_heap<size_t, std::less<size_t>, TypeParam> heap;
+  std::vector<size_t> expected;
+  size_t v = 7;
+  for (size_t i = 0; i < 200; ++i) {
+    v = (v * 31 + 11) % 97;
+    heap.push(v);
+    expected.push_back(v);
+  }
+  std::sort(expected.begin(), expected.end());
+
+  {
+    auto copy = heap;
+    const auto& seq = copy.extract_sequence();
+    EXPECT_EQ(seq.size(), expected.size());
+    EXPECT_TRUE(is_minmax_heap(seq.begin(), seq.end()));
+    EXPECT_TRUE(copy.empty());
+  }
+
+  auto first = expected.begin();
+  auto last = expected.end();
+  while (!heap.empty()) {
+    ASSERT_EQ(heap.size(), static_cast<size_t>(last - first));
+    ASSERT_EQ(heap.front(), *first);
+    ASSERT_EQ(heap.back(), *std::prev(last));
+    if (heap.size() % 3 == 0) {
+      heap.pop_back();
+      --last;
+    } else {
+      heap.pop_front();
+      ++first;
+    }
+  }
+}
+
+TYPED_TEST(BlockedMinMaxHeapTest, adopt_sequence) {
+  std::vector<size_t> seq(100);
+  std::iota(seq.rbegin(), seq.rend(), size_t{0});
+  using heap_type = minmax_heap<size_t, std::less<size_t>, TypeParam>;
+  heap_type heap{seq};
+  EXPECT_EQ(heap.size(), 100);
+  EXPECT_EQ(heap.front(), 0);
+  EXPECT_EQ(heap.back(), 99);
+
+  const auto& extracted = heap.extract_sequence();
+  EXPECT_TRUE(is_minmax_heap(extracted.begin(), extracted.end()));
+
+  heap.adopt_sequence(typename heap_type::minmax_heap_range_t{}, extracted);
+  EXPECT_EQ(heap.size(), 100);
+  EXPECT_EQ(heap.front(), 0);
+  EXPECT_EQ(heap.back(), 99);
+}
+
+template <typename Heap>
+std::vector<size_t> drain_front(Heap& heap) {
+  std::vector<size_t> retval;
+  while (!heap.empty()) {
+    retval.push_back(heap.front());
+    heap.pop_front();
+  }
+  return retval;
+}
+
+TEST(MinMaxHeap, push_range_few) {
+  std::vector<size_t> values(100);
+  std::iota(values.begin(), values.end(), size_t{0});
+  std::reverse(values.begin(), values.end());
+
+  minmax_heap<size_t> heap{
+      std::vector<size_t>(values.begin() + 10, values.end())};
+  heap.push_range(values.begin(), values.begin() + 10);
+  EXPECT_EQ(heap.size(), 100);
+  EXPECT_EQ(heap.back(), 99);
+
+  auto copy = heap;
+  const auto& seq = copy.extract_sequence();
+  EXPECT_TRUE(is_minmax_heap(seq.begin(), seq.end()));
+
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(drain_front(heap), values);
+}
+
+TEST(MinMaxHeap, push_range_many) {
+  std::vector<size_t> values(100);
+  std::iota(values.begin(), values.end(), size_t{0});
+
+  minmax_heap<size_t, std::less<size_t>, blocked_layout<2>> heap;
+  heap.push(50);
+  heap.push(51);
+  heap.push_range(values.begin(), values.end());
+  EXPECT_EQ(heap.size(), 102);
+
+  values.push_back(50);
+  values.push_back(51);
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(drain_front(heap), values);
+}
+
+TEST(MinMaxHeap, push_range_across_levels) {
+  // Check every split of the elements between the initial heap and the range
+  for (size_t n = 2; n < 70; ++n) {
+    for (size_t k = 1; k < n; ++k) {
+      std::vector<size_t> values(n);
+      for (size_t i = 0; i < n; ++i) {
+        values[i] = (i * 37) % n;
+      }
+      const auto split = values.end() - static_cast<std::ptrdiff_t>(k);
+      minmax_heap<size_t> heap{std::vector<size_t>(values.begin(), split)};
+      heap.push_range(split, values.end());
+      const auto& seq = heap.extract_sequence();
+      ASSERT_TRUE(is_minmax_heap(seq.begin(), seq.end()));
+    }
+  }
+}
+
+TEST(MinMaxHeap, merge) {
+  minmax_heap<size_t> a;
+  minmax_heap<size_t> b;
+  std::vector<size_t> expected;
+  for (size_t i = 0; i < 10; ++i) {
+    a.push(i * 3);
+    expected.push_back(i * 3);
+  }
+  for (size_t i = 0; i < 40; ++i) {
+    b.push(i * 2 + 1);
+    expected.push_back(i * 2 + 1);
+  }
+
+  a.merge(std::move(b));
+  EXPECT_EQ(a.size(), 50);
+  std::sort(expected.begin(), expected.end());
+  EXPECT_EQ(drain_front(a), expected);
+}
+
+TEST(MinMaxHeap, replace_front) {
+  // Keep the 10 largest values seen
+  minmax_heap<size_t> heap;
+  std::vector<size_t> values;
+  for (size_t i = 0; i < 200; ++i) {
+    const auto v = (i * 7919) % 211;
+    values.push_back(v);
+    if (heap.size() < 10) {
+      heap.push(v);
+    } else if (heap.front() < v) {
+      heap.replace_front(v);
+    }
+  }
+  std::sort(values.begin(), values.end());
+  EXPECT_EQ(drain_front(heap),
+            std::vector<size_t>(values.end() - 10, values.end()));
+}
+
+TEST(MinMaxHeap, replace_back) {
+  std::vector<size_t> values(20);
+  std::iota(values.begin(), values.end(), size_t{10});
+  minmax_heap<size_t> heap{values};
+
+  // Replace the max with something in the middle, the back and the front
+  heap.replace_back(15);
+  EXPECT_EQ(heap.back(), 28);
+  heap.replace_back(100);
+  EXPECT_EQ(heap.back(), 100);
+  heap.replace_back(0);
+  EXPECT_EQ(heap.front(), 0);
+  EXPECT_EQ(heap.back(), 27);
+
+  auto copy = heap;
+  const auto& seq = copy.extract_sequence();
+  EXPECT_TRUE(is_minmax_heap(seq.begin(), seq.end()));
+
+  minmax_heap<size_t> single;
+  single.push(1);
+  single.replace_back(2);
+  EXPECT_EQ(single.front(), 2);
+  EXPECT_EQ(single.back(), 2);
+}
+
+TEST_F(MinMaxHeapNoCopyFixture, pop_value_no_copy) {
+  for (size_t i = 0; i < 8; ++i) {
+    const auto front = pop_front_value();
+    EXPECT_EQ(front.value, i);
+    EXPECT_EQ(front.copies, 0);
+
+    const auto back = pop_back_value();
+    EXPECT_EQ(back.value, 15 - i);
+    EXPECT_EQ(back.copies, 0);
+  }
+  EXPECT_TRUE(empty());
+}
+
+TEST_F(MinMaxHeapNoCopyFixture, replace_no_copy) {
+  replace_front(CopyCounter{100});
+  replace_back(CopyCounter{200});
+  EXPECT_EQ(front().value, 1);
+  EXPECT_EQ(back().value, 200);
+  EXPECT_EQ(back().copies, 0);
+}
+
+TEST(MinMaxHeap, pop_with_duplicates) {
+  std::vector<size_t> values;
+  for (size_t i = 0; i < 500; ++i) {
+    values.push_back((i * 7) % 13);
+  }
+  minmax_heap<size_t> heap{values};
+  std::sort(values.begin(), values.end());
+  for (size_t i = 0; i < values.size() / 2; ++i) {
+    EXPECT_EQ(heap.pop_front_value(), values[i]);
+    EXPECT_EQ(heap.pop_back_value(), values[values.size() - 1 - i]);
+    auto copy = heap;
+    const auto& seq = copy.extract_sequence();
+    ASSERT_TRUE(is_minmax_heap(seq.begin(), seq.end()));
+  }
+}
+
+template <typename Heap>
+void test_string_pops() {
+  Heap heap;
+  for (const auto* s : {"m", "z", "y", "a", "b", "c", "d"}) {
+    heap.push(s);
+  }
+  // Each pop must remove the element it returned, not whatever is left in
+  // the slot it was moved out of
+  EXPECT_EQ(heap.pop_back_value(), "z");
+  EXPECT_EQ(heap.pop_back_value(), "y");
+  EXPECT_EQ(heap.pop_front_value(), "a");
+  std::vector<std::string> rest;
+  while (!heap.empty()) {
+    rest.push_back(heap.pop_back_value());
+  }
+  EXPECT_EQ(rest, (std::vector<std::string>{"m", "d", "c", "b"}));
+}
+
+TEST(MinMaxHeap, pop_strings) {
+  test_string_pops<minmax_heap<std::string>>();
+  test_string_pops<
+      minmax_heap<std::string, std::less<std::string>, blocked_layout<2>>>();
+}
+
+template <typename Heap>
+void test_parallel_build(size_t n, size_t num_threads) {
+  std::vector<size_t> values(n);
+  size_t v = 1;
+  for (auto& value : values) {
+    v = (v * 6364136223846793005u + 1442695040888963407u);
+    value = v >> 40;
+  }
+  const auto comp = typename Heap::value_compare{};
+  const auto [min_it, max_it] =
+      std::minmax_element(values.begin(), values.end(), comp);
+  const auto min = *min_it;
+  const auto max = *max_it;
+
+  Heap heap{typename Heap::parallel_t{num_threads}, std::move(values)};
+  EXPECT_EQ(heap.size(), n);
+  EXPECT_EQ(heap.front(), min);
+  EXPECT_EQ(heap.back(), max);
+  const auto& seq = heap.extract_sequence();
+  EXPECT_TRUE(is_minmax_heap(seq.begin(), seq.end(), comp));
+}
+
+TEST(MinMaxHeap, parallel_build) {
+  test_parallel_build<minmax_heap<size_t>>(300'000, 4);
+  test_parallel_build<minmax_heap<size_t>>(200'001, 3);
+  test_parallel_build<minmax_heap<size_t, std::greater<>>>(100'000, 7);
+  test_parallel_build<minmax_heap<size_t, std::less<>, blocked_layout<3>>>(
+      100'000, 2);
+  // Small heaps are built serially
+  test_parallel_build<minmax_heap<size_t>>(100, 4);
+}
+
+TEST(MinMaxHeap, parallel_adopt_sequence) {
+  std::vector<size_t> values(100'000);
+  std::iota(values.rbegin(), values.rend(), size_t{0});
+  minmax_heap<size_t> heap;
+  heap.adopt_sequence(minmax_heap<size_t>::parallel_t{4}, std::move(values));
+  EXPECT_EQ(heap.front(), 0);
+  EXPECT_EQ(heap.back(), 99'999);
+  const auto& seq = heap.extract_sequence();
+  EXPECT_TRUE(is_minmax_heap(seq.begin(), seq.end()));
+}
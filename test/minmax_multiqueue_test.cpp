@@ -0,0 +1,116 @@
+#include <gtest/gtest.h>
+#include <minmax_multiqueue.h>
+
+#include <algorithm>
+#include <atomic>
+#include <numeric>
+#include <string>
+#include <thread>
+#include <vector>
+
+using namespace misc;
+
+TEST(MinMaxMultiQueue, single_heap_is_exact) {
+  minmax_multiqueue<size_t> queue(1);
+  EXPECT_TRUE(queue.empty());
+  EXPECT_FALSE(queue.try_pop_min());
+  EXPECT_FALSE(queue.try_pop_max());
+
+  for (size_t i : std::initializer_list<size_t>{5, 1, 9, 3, 7}) {
+    queue.push(i);
+  }
+  EXPECT_EQ(queue.size(), 5);
+  EXPECT_EQ(queue.try_pop_min(), 1);
+  EXPECT_EQ(queue.try_pop_max(), 9);
+  EXPECT_EQ(queue.try_pop_min(), 3);
+  EXPECT_EQ(queue.try_pop_max(), 7);
+  EXPECT_EQ(queue.try_pop_min(), 5);
+  EXPECT_FALSE(queue.try_pop_min());
+  EXPECT_TRUE(queue.empty());
+}
+
+TEST(MinMaxMultiQueue, single_heap_pops_strings_from_the_back) {
+  minmax_multiqueue<std::string> queue(1);
+  for (const auto* s : {"g", "d", "j", "e", "h", "f", "i"}) {
+    queue.push(s);
+  }
+  std::vector<std::string> popped;
+  while (auto s = queue.try_pop_max()) {
+    popped.push_back(*s);
+  }
+  EXPECT_EQ(popped,
+            (std::vector<std::string>{"j", "i", "h", "g", "f", "e", "d"}));
+}
+
+TEST(MinMaxMultiQueue, pops_every_element) {
+  minmax_multiqueue<size_t> queue(8);
+  for (size_t i = 0; i < 1000; ++i) {
+    queue.push(i);
+  }
+  EXPECT_EQ(queue.size(), 1000);
+
+  std::vector<size_t> popped;
+  while (auto v = (popped.size() % 2 ? queue.try_pop_max()
+                                     : queue.try_pop_min())) {
+    popped.push_back(*v);
+  }
+  EXPECT_TRUE(queue.empty());
+  std::sort(popped.begin(), popped.end());
+  std::vector<size_t> expected(1000);
+  std::iota(expected.begin(), expected.end(), size_t{0});
+  EXPECT_EQ(popped, expected);
+}
+
+TEST(MinMaxMultiQueue, relaxed_order) {
+  minmax_multiqueue<size_t> queue(4);
+  for (size_t i = 0; i < 10'000; ++i) {
+    queue.push(i);
+  }
+  // The first pops come from the fronts of the heaps, so they're all small
+  for (size_t i = 0; i < 10; ++i) {
+    EXPECT_LT(*queue.try_pop_min(), 1'000);
+    EXPECT_GT(*queue.try_pop_max(), 9'000);
+  }
+}
+
+TEST(MinMaxMultiQueue, concurrent) {
+  constexpr size_t num_threads = 4;
+  constexpr size_t per_thread = 5'000;
+  minmax_multiqueue<size_t> queue(2 * num_threads);
+
+  std::vector<std::thread> producers;
+  for (size_t t = 0; t < num_threads; ++t) {
+    producers.emplace_back([&, t] {
+      for (size_t i = 0; i < per_thread; ++i) {
+        queue.push(t * per_thread + i);
+      }
+    });
+  }
+
+  std::atomic<size_t> popped_count{0};
+  std::vector<std::vector<size_t>> popped(num_threads);
+  std::vector<std::thread> consumers;
+  for (size_t t = 0; t < num_threads; ++t) {
+    consumers.emplace_back([&, t] {
+      while (popped_count.load() < num_threads * per_thread) {
+        if (auto v = t % 2 ? queue.try_pop_max() : queue.try_pop_min()) {
+          popped[t].push_back(*v);
+          ++popped_count;
+        }
+      }
+    });
+  }
+
+  for (auto& thread : producers) thread.join();
+  for (auto& thread : consumers) thread.join();
+
+  std::vector<size_t> all;
+  for (const auto& p : popped) {
+    all.insert(all.end(), p.begin(), p.end());
+  }
+  std::sort(all.begin(), all.end());
+  std::vector<size_t> expected(num_threads * per_thread);
+  std::iota(expected.begin(), expected.end(), size_t{0});
+  EXPECT_EQ(all, expected);
+  EXPECT_TRUE(queue.empty());
+}
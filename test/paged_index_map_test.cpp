@@ -0,0 +1,78 @@
+#include <gmock/gmock.h>
+#include <gtest/gtest.h>
+#include <paged_index_map.h>
+
+#include <cstddef>
+#include <iterator>
+#include <string>
+#include <utility>
+#include <vector>
+
+using misc::paged_dense_index_map;
+
+TEST(PagedDenseIndexMap, SparseKeysAllocateOnlyTheirPages) {
+  paged_dense_index_map<size_t, std::string> m;
+  EXPECT_EQ(m.begin(), m.end());
+
+  auto [it, emplaced] = m.emplace(10'000'000, "far");
+  EXPECT_TRUE(emplaced);
+  EXPECT_EQ(it->first, 10'000'000);
+  EXPECT_EQ(it->second, "far");
+  m[3] = "near";
+  EXPECT_EQ(m.size(), 2);
+  EXPECT_EQ(m.page_count(), 2);
+
+  EXPECT_FALSE(m.emplace(3, "again").second);
+  EXPECT_EQ(m.find(3)->second, "near");
+  EXPECT_EQ(m.find(4), m.end());
+  EXPECT_EQ(m.find(20'000'000), m.end());
+}
+
+TEST(PagedDenseIndexMap, Iterate) {
+  paged_dense_index_map<size_t, size_t, misc::identity, 64> m;
+  const std::vector<size_t> keys{0, 63, 64, 1000, 5000, 5001};
+  for (const auto k : keys) {
+    m[k] = k * 2;
+  }
+
+  std::vector<size_t> forward;
+  for (auto it = m.begin(); it != m.end(); ++it) {
+    const auto* p = it.operator->();
+    ASSERT_NE(p, nullptr);
+    EXPECT_EQ(p->second, p->first * 2);
+    forward.push_back(p->first);
+  }
+  EXPECT_EQ(forward, keys);
+
+  std::vector<size_t> backward;
+  const auto& cm = m;
+  for (auto it = std::make_reverse_iterator(cm.end());
+       it != std::make_reverse_iterator(cm.begin()); ++it) {
+    backward.push_back(it->first);
+  }
+  using namespace ::testing;
+  EXPECT_THAT(backward, ElementsAre(5001, 5000, 1000, 64, 63, 0));
+}
+
+TEST(PagedDenseIndexMap, EraseFreesEmptyPages) {
+  paged_dense_index_map<size_t, size_t, misc::identity, 64> m;
+  m[1] = 1;
+  m[2] = 2;
+  m[200] = 200;
+  EXPECT_EQ(m.page_count(), 2);
+
+  const auto next = m.erase(m.find(1));
+  EXPECT_EQ(next, m.find(2));
+  EXPECT_EQ(m.erase(200), 1);
+  EXPECT_EQ(m.erase(200), 0);
+  EXPECT_EQ(m.page_count(), 1);
+  EXPECT_EQ(m.erase(m.find(2)), m.end());
+  EXPECT_EQ(m.page_count(), 0);
+  EXPECT_TRUE(m.empty());
+
+  m[7] = 7;
+  const auto copy = m;
+  m.clear();
+  EXPECT_EQ(copy.find(7)->second, 7);
+  EXPECT_EQ(m.find(7), m.end());
+}
@@ -0,0 +1,117 @@
+#include <dense_index_map.h>
+#include <gtest/gtest.h>
+#include <perfect_hash.h>
+
+#include <array>
+#include <cstddef>
+#include <stdexcept>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using misc::perfect_hash_index;
+
+namespace {
+constexpr std::array<std::string_view, 7> field_names{
+    "id", "name", "size", "mtime", "owner", "group", "mode"};
+constexpr perfect_hash_index<field_names.size()> field_index{field_names};
+
+// Built entirely at compile time
+static_assert(field_index("owner") < field_names.size());
+static_assert(field_index(field_index("owner")) == "owner");
+static_assert(field_index("missing") == field_index.npos);
+
+// Keys "f000", "f001", ..., built at compile time
+template <size_t N>
+struct numbered_keys {
+  static constexpr size_t LEN = 4;
+  std::array<char, N * LEN> chars{};
+
+  constexpr numbered_keys() {
+    for (size_t i = 0; i < N; ++i) {
+      chars[i * LEN] = 'f';
+      chars[i * LEN + 1] = static_cast<char>('0' + i / 100 % 10);
+      chars[i * LEN + 2] = static_cast<char>('0' + i / 10 % 10);
+      chars[i * LEN + 3] = static_cast<char>('0' + i % 10);
+    }
+  }
+
+  [[nodiscard]] constexpr std::array<std::string_view, N> views() const {
+    std::array<std::string_view, N> retval{};
+    for (size_t i = 0; i < N; ++i) {
+      retval[i] = std::string_view(chars.data() + i * LEN, LEN);
+    }
+    return retval;
+  }
+};
+
+constexpr numbered_keys<500> many_key_chars;
+constexpr auto many_keys = many_key_chars.views();
+constexpr perfect_hash_index<many_keys.size()> many_index{many_keys};
+
+constexpr bool maps_every_key_back() {
+  for (const auto key : many_keys) {
+    if (many_index(many_index(key)) != key) return false;
+  }
+  return many_index("f500") == many_index.npos;
+}
+
+// A few hundred keys still build within the constexpr evaluation limits
+static_assert(maps_every_key_back());
+}  // namespace
+
+TEST(PerfectHashIndex, Bijective) {
+  std::vector<bool> seen(field_names.size());
+  for (const auto name : field_names) {
+    const auto i = field_index(name);
+    ASSERT_LT(i, field_names.size());
+    EXPECT_FALSE(seen[i]);
+    seen[i] = true;
+    EXPECT_EQ(field_index(i), name);
+  }
+  EXPECT_EQ(field_index(""), field_names.size());
+  EXPECT_EQ(field_index("i"), field_names.size());
+}
+
+TEST(PerfectHashIndex, ManyKeys) {
+  std::vector<std::string> storage;
+  for (size_t i = 0; i < 500; ++i) {
+    storage.push_back("key_" + std::to_string(i * 7919));
+  }
+  std::array<std::string_view, 500> keys{};
+  for (size_t i = 0; i < keys.size(); ++i) {
+    keys[i] = storage[i];
+  }
+  const perfect_hash_index<500> index{keys};
+  std::vector<bool> seen(keys.size());
+  for (const auto key : keys) {
+    const auto i = index(key);
+    ASSERT_LT(i, keys.size());
+    EXPECT_FALSE(seen[i]);
+    seen[i] = true;
+  }
+
+  keys[1] = keys[0];
+  EXPECT_THROW(perfect_hash_index<500>{keys}, std::invalid_argument);
+}
+
+TEST(PerfectHashIndex, DenseMap) {
+  using index_type = perfect_hash_index<field_names.size()>;
+  misc::dense_dynamic_index_map<std::string_view, int, index_type, index_type>
+      m(index_type::size(), field_index, field_index);
+  m["size"] = 4096;
+  m.emplace("mode", 0644);
+  EXPECT_EQ(m.find("size")->second, 4096);
+  EXPECT_EQ(m.find("mode")->first, "mode");
+  EXPECT_EQ(m.find("owner"), m.end());
+  EXPECT_EQ(m.find("not a field"), m.end());
+  EXPECT_THROW(m["not a field"] = 1, std::out_of_range);
+  EXPECT_THROW(m.emplace("not a field", 1), std::out_of_range);
+
+  size_t count = 0;
+  for (const auto& [name, value] : m) {
+    EXPECT_TRUE(name == "size" || name == "mode");
+    ++count;
+  }
+  EXPECT_EQ(count, 2);
+}
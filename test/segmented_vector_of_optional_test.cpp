@@ -0,0 +1,96 @@
+#include <gtest/gtest.h>
+#include <segmented_vector_of_optional.h>
+
+#include <cstddef>
+#include <optional>
+#include <vector>
+
+#include "test.h"
+
+using misc::segmented_vector_of_optional;
+
+TEST(SegmentedVectorOfOptional, StableAddresses) {
+  segmented_vector_of_optional<size_t> v;
+  std::vector<const size_t*> pointers;
+  for (size_t i = 0; i < 10'000; ++i) {
+    if (i % 3 == 0) {
+      EXPECT_EQ(v.emplace_back(std::nullopt), nullptr);
+      pointers.push_back(nullptr);
+    } else {
+      pointers.push_back(v.emplace_back(i));
+    }
+  }
+  EXPECT_EQ(v.size(), 10'000);
+  EXPECT_GE(v.capacity(), 10'000);
+  EXPECT_LT(v.capacity(), 20'000);
+
+  size_t count = 0;
+  for (size_t i = 0; i < v.size(); ++i) {
+    ASSERT_EQ(v[i], pointers[i]);
+    if (pointers[i]) {
+      ASSERT_EQ(*v[i], i);
+      ++count;
+    }
+  }
+  EXPECT_EQ(v.count(), count);
+}
+
+TEST(SegmentedVectorOfOptional, Scan) {
+  segmented_vector_of_optional<size_t> v;
+  v.resize(5000);
+  const std::vector<size_t> set = {0, 63, 64, 191, 192, 1000, 4999};
+  for (const auto i : set) {
+    v.emplace_at(i, i);
+  }
+
+  std::vector<size_t> found;
+  for (auto i = v.first_set(); i != v.size(); i = v.next_set(i + 1)) {
+    found.push_back(i);
+  }
+  EXPECT_EQ(found, set);
+
+  found.clear();
+  v.for_each_set([&](size_t i, size_t value) {
+    EXPECT_EQ(i, value);
+    found.push_back(i);
+  });
+  EXPECT_EQ(found, set);
+
+  v.resize(192);
+  EXPECT_EQ(v.count(), 4);
+  EXPECT_EQ(v.next_set(64), 64);
+  EXPECT_EQ(v.next_set(65), 191);
+  v.reset(191);
+  EXPECT_EQ(v.next_set(65), v.size());
+}
+
+using SegmentedVectorOfOptionalCountingFixture = SpecMemberCountingFixture;
+
+TEST_F(SegmentedVectorOfOptionalCountingFixture, NoMovesOnGrowth) {
+  segmented_vector_of_optional<TestElement> v;
+  for (size_t i = 0; i < 1000; ++i) {
+    v.emplace_back(i);
+  }
+  EXPECT_EQ(call_counts.constructor_calls, 1000);
+  EXPECT_EQ(call_counts.move_constructor_calls, 0);
+
+  const auto copy = v;
+  EXPECT_EQ(call_counts.copy_constructor_calls, 1000);
+  EXPECT_EQ(copy[999]->v, 999);
+
+  v.clear();
+  EXPECT_EQ(call_counts.destructor_calls, 1000);
+}
+
+TEST(SegmentedVectorOfOptional, MemoryResource) {
+  CountingResource resource;
+  {
+    segmented_vector_of_optional<size_t> v(&resource);
+    for (size_t i = 0; i < 1000; ++i) {
+      v.emplace_back(i);
+    }
+    // Segments of 64, 128, 256, 512 and 1024 slots
+    EXPECT_EQ(resource.allocations, 5);
+  }
+  EXPECT_EQ(resource.live_bytes, 0);
+}
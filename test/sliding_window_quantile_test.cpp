@@ -0,0 +1,131 @@
+#include <gtest/gtest.h>
+#include <sliding_window_quantile.h>
+
+#include <algorithm>
+#include <cmath>
+#include <deque>
+#include <functional>
+#include <stdexcept>
+#include <vector>
+
+using namespace misc;
+
+namespace {
+std::vector<size_t> make_stream(size_t n, size_t seed) {
+  std::vector<size_t> retval;
+  for (size_t i = 0; i < n; ++i) {
+    seed = (seed * 6364136223846793005u + 1442695040888963407u);
+    retval.push_back((seed >> 33) % 100);
+  }
+  return retval;
+}
+
+template <typename Comp = std::less<>>
+size_t reference_quantile(const std::deque<size_t>& window, double q,
+                          Comp comp = Comp{}) {
+  std::vector<size_t> sorted(window.begin(), window.end());
+  std::sort(sorted.begin(), sorted.end(), comp);
+  return sorted[static_cast<size_t>(
+      std::floor(q * static_cast<double>(sorted.size() - 1)))];
+}
+
+// Its move throws once moves_left runs out
+struct throwing_move {
+  static inline int moves_left = -1;
+  int value;
+
+  explicit throwing_move(int v) : value(v) {}
+  throwing_move(const throwing_move&) = default;
+  throwing_move(throwing_move&& o) : value(o.value) {
+    if (moves_left >= 0 && moves_left-- == 0) {
+      throw std::runtime_error("move");
+    }
+  }
+  throwing_move& operator=(const throwing_move&) = default;
+  throwing_move& operator=(throwing_move&&) = default;
+  ~throwing_move() = default;
+
+  [[nodiscard]] friend bool operator<(const throwing_move& lhs,
+                                      const throwing_move& rhs) {
+    return lhs.value < rhs.value;
+  }
+};
+}  // namespace
+
+TEST(SlidingWindowQuantile, median) {
+  sliding_window_quantile<size_t> median;
+  median.push(5);
+  EXPECT_EQ(median.quantile(), 5);
+  median.push(1);
+  EXPECT_EQ(median.quantile(), 1);
+  median.push(3);
+  EXPECT_EQ(median.quantile(), 3);
+  median.expire();
+  EXPECT_EQ(median.size(), 2);
+  EXPECT_EQ(median.quantile(), 1);
+  median.expire();
+  EXPECT_EQ(median.quantile(), 3);
+  median.expire();
+  EXPECT_TRUE(median.empty());
+}
+
+TEST(SlidingWindowQuantile, fixed_window) {
+  const auto stream = make_stream(2000, 1);
+  for (const double q : {0.0, 0.5, 0.9, 1.0}) {
+    sliding_window_quantile<size_t> quantile(q);
+    std::deque<size_t> window;
+    for (const auto v : stream) {
+      quantile.push(v);
+      window.push_back(v);
+      if (window.size() > 37) {
+        quantile.expire();
+        window.pop_front();
+      }
+      ASSERT_EQ(quantile.quantile(), reference_quantile(window, q));
+    }
+  }
+}
+
+TEST(SlidingWindowQuantile, advance) {
+  const auto stream = make_stream(3000, 2);
+  sliding_window_quantile<size_t, std::greater<>> quantile(0.25);
+  std::deque<size_t> window;
+  size_t next = 0;
+  for (size_t round = 0; next < stream.size(); ++round) {
+    const auto n_new = std::min<size_t>(round % 23 + 1, stream.size() - next);
+    const auto n_expired = std::min<size_t>(round % 17, window.size());
+    quantile.advance(stream.begin() + static_cast<std::ptrdiff_t>(next),
+                     stream.begin() + static_cast<std::ptrdiff_t>(next + n_new),
+                     n_expired);
+    window.erase(window.begin(),
+                 window.begin() + static_cast<std::ptrdiff_t>(n_expired));
+    window.insert(window.end(),
+                  stream.begin() + static_cast<std::ptrdiff_t>(next),
+                  stream.begin() + static_cast<std::ptrdiff_t>(next + n_new));
+    next += n_new;
+    ASSERT_EQ(quantile.size(), window.size());
+    ASSERT_EQ(quantile.quantile(),
+              reference_quantile(window, 0.25, std::greater<>{}));
+  }
+}
+
+TEST(SlidingWindowQuantile, failed_push) {
+  sliding_window_quantile<throwing_move> quantile(0.5);
+  for (const int v : {5, 1, 9}) {
+    quantile.push(throwing_move{v});
+  }
+  // The first move, into insert(), succeeds, and the next one, into the
+  // heap's node, throws
+  throwing_move::moves_left = 1;
+  EXPECT_THROW(quantile.push(throwing_move{3}), std::runtime_error);
+  throwing_move::moves_left = -1;
+  EXPECT_EQ(quantile.size(), 3);
+  EXPECT_EQ(quantile.quantile().value, 5);
+
+  // Every sample left can still be expired
+  quantile.expire();
+  EXPECT_EQ(quantile.quantile().value, 1);
+  quantile.expire();
+  quantile.expire();
+  EXPECT_TRUE(quantile.empty());
+}
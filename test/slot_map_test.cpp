@@ -0,0 +1,92 @@
+#include <gtest/gtest.h>
+#include <slot_map.h>
+
+#include <cstddef>
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "test.h"
+
+using misc::slot_map;
+
+TEST(SlotMap, InsertGetErase) {
+  slot_map<std::string> m;
+  const auto a = m.insert("a");
+  const auto b = m.insert(size_t{3}, 'b');
+  EXPECT_EQ(m.size(), 2);
+  ASSERT_NE(m.get(a), nullptr);
+  EXPECT_EQ(*m.get(a), "a");
+  ASSERT_NE(m.get(b), nullptr);
+  EXPECT_EQ(*m.get(b), "bbb");
+
+  EXPECT_TRUE(m.erase(a));
+  EXPECT_FALSE(m.erase(a));
+  EXPECT_EQ(m.get(a), nullptr);
+  EXPECT_FALSE(m.contains(a));
+  EXPECT_EQ(m.size(), 1);
+
+  // The slot is reused, but the old handle stays stale
+  const auto c = m.insert("c");
+  EXPECT_EQ(c.index, a.index);
+  EXPECT_NE(c, a);
+  EXPECT_EQ(m.get(a), nullptr);
+  ASSERT_NE(m.get(c), nullptr);
+  EXPECT_EQ(*m.get(c), "c");
+  EXPECT_EQ(m.slot_count(), 2);
+
+  EXPECT_EQ(m.get({7, 0}), nullptr);
+}
+
+TEST(SlotMap, FreeListIsLifo) {
+  slot_map<size_t> m;
+  std::vector<misc::slot_map_handle> handles;
+  for (size_t i = 0; i < 100; ++i) {
+    handles.push_back(m.insert(i));
+  }
+  m.erase(handles[10]);
+  m.erase(handles[50]);
+  EXPECT_EQ(m.insert(size_t{1}).index, 50);
+  EXPECT_EQ(m.insert(size_t{2}).index, 10);
+  EXPECT_EQ(m.insert(size_t{3}).index, 100);
+  EXPECT_EQ(m.size(), 101);
+}
+
+TEST(SlotMap, ForEach) {
+  slot_map<size_t, misc::summarized_occupancy> m;
+  std::vector<misc::slot_map_handle> handles;
+  for (size_t i = 0; i < 1000; ++i) {
+    handles.push_back(m.insert(i));
+  }
+  for (size_t i = 0; i < 1000; ++i) {
+    if (i % 7 != 0) m.erase(handles[i]);
+  }
+
+  size_t visited = 0;
+  const auto& cm = m;
+  cm.for_each([&](misc::slot_map_handle h, const size_t& value) {
+    EXPECT_EQ(value % 7, 0);
+    EXPECT_EQ(h, handles[value]);
+    ++visited;
+  });
+  EXPECT_EQ(visited, m.size());
+
+  m.for_each([](misc::slot_map_handle, size_t& value) { value = 0; });
+  EXPECT_EQ(*m.get(handles[7]), 0);
+}
+
+using SlotMapCountingFixture = SpecMemberCountingFixture;
+
+TEST_F(SlotMapCountingFixture, Clear) {
+  slot_map<TestElement> m;
+  const auto a = m.insert();
+  m.insert();
+  const auto destructions = call_counts.destructor_calls;
+  m.clear();
+  EXPECT_EQ(call_counts.destructor_calls, destructions + 2);
+  EXPECT_TRUE(m.empty());
+  EXPECT_EQ(m.get(a), nullptr);
+  const auto b = m.insert();
+  EXPECT_EQ(m.slot_count(), 2);
+  EXPECT_NE(m.get(b), nullptr);
+}
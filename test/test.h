@@ -3,6 +3,8 @@
 #include <gmock/gmock.h>
 #include <gtest/gtest.h>
 
+#include <memory_resource>
+
 struct SpecMemberCountingFixture : public testing::Test {
   static struct CallCounter {
     size_t constructor_calls = 0;
@@ -105,3 +107,28 @@ struct CopyRecorder {
   size_t copy_assigned = 0;
   size_t move_assigned = 0;
 };
+
+// Forwards to another resource, counting allocations and live bytes
+struct CountingResource : std::pmr::memory_resource {
+  explicit CountingResource(
+      std::pmr::memory_resource* upstream_ = std::pmr::new_delete_resource())
+      : upstream(upstream_) {}
+
+  std::pmr::memory_resource* upstream;
+  size_t allocations = 0;
+  size_t live_bytes = 0;
+
+ private:
+  void* do_allocate(size_t bytes, size_t alignment) override {
+    ++allocations;
+    live_bytes += bytes;
+    return upstream->allocate(bytes, alignment);
+  }
+  void do_deallocate(void* p, size_t bytes, size_t alignment) override {
+    live_bytes -= bytes;
+    upstream->deallocate(p, bytes, alignment);
+  }
+  bool do_is_equal(const std::pmr::memory_resource& o) const noexcept override {
+    return this == &o;
+  }
+};
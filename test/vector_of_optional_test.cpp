@@ -2,11 +2,40 @@
 #include <vector_of_optional.h>
 
 #include <cstddef>
+#include <cstdint>
+#include <limits>
 #include <memory>
+#include <memory_resource>
 #include <optional>
+#include <stdexcept>
+#include <string>
+#include <utility>
+#include <vector>
 
 #include "test.h"
 
+namespace {
+// Not trivially copyable, but safe to relocate with memcpy
+struct Relocatable {
+  static inline size_t moves = 0;
+  std::unique_ptr<size_t> p;
+  explicit Relocatable(size_t v) : p(std::make_unique<size_t>(v)) {}
+  Relocatable(Relocatable&& o) noexcept : p(std::move(o.p)) { ++moves; }
+};
+}  // namespace
+
+template <>
+struct misc::is_trivially_relocatable<Relocatable> : std::true_type {};
+
+namespace {
+enum class NodeIndex : uint32_t {};
+constexpr NodeIndex no_node{~uint32_t{0}};
+}  // namespace
+
+template <>
+struct misc::optional_niche<NodeIndex>
+    : misc::sentinel_niche<NodeIndex, no_node> {};
+
 class VectorOfOptionalFixture
     : public misc::VectorOfOptional<std::shared_ptr<int>>,
       public testing::Test {
@@ -273,3 +302,347 @@ TEST_F(VectorOfOptionalCountingFixture, Move) {
 
   EXPECT_EQ(call_counts.allocating_new_calls, 0);
 }
+
+TEST(VectorOfOptional, BitScan) {
+  misc::VectorOfOptional<size_t> v;
+  v.resize(300);
+  const std::vector<size_t> set = {0, 5, 63, 64, 127, 200, 299};
+  for (const auto i : set) {
+    v.emplace_at(i, i * 10);
+  }
+  EXPECT_EQ(v.count(), set.size());
+
+  std::vector<size_t> found;
+  for (size_t i = v.next_set(0); i != v.size(); i = v.next_set(i + 1)) {
+    found.push_back(i);
+  }
+  EXPECT_EQ(found, set);
+
+  found.clear();
+  for (size_t i = v.prev_set(v.size()); i != v.npos; i = v.prev_set(i)) {
+    found.insert(found.begin(), i);
+  }
+  EXPECT_EQ(found, set);
+
+  EXPECT_EQ(v.next_set(6), 63);
+  EXPECT_EQ(v.next_set(65), 127);
+  EXPECT_EQ(v.prev_set(127), 64);
+  EXPECT_EQ(v.prev_set(0), v.npos);
+
+  found.clear();
+  std::as_const(v).for_each_set([&](size_t i, const size_t& value) {
+    EXPECT_EQ(value, i * 10);
+    found.push_back(i);
+  });
+  EXPECT_EQ(found, set);
+
+  v.resize(128);
+  EXPECT_EQ(v.count(), 5);
+  EXPECT_EQ(v.next_set(128), v.size());
+  v.clear();
+  EXPECT_EQ(v.count(), 0);
+  EXPECT_EQ(v.size(), 0);
+}
+
+TEST_F(VectorOfOptionalCountingFixture, CopyAssign) {
+  misc::VectorOfOptional<TestElement> v;
+  v.emplace_back();
+  v.emplace_back(std::nullopt);
+  v.emplace_back();
+
+  misc::VectorOfOptional<TestElement> v2;
+  v2.emplace_back();
+  const auto destroyed = call_counts.destructor_calls;
+  v2 = v;
+  EXPECT_EQ(v2.size(), 3);
+  EXPECT_EQ(v2.count(), 2);
+  EXPECT_EQ(call_counts.copy_constructor_calls, 2);
+  EXPECT_EQ(call_counts.destructor_calls, destroyed + 1);
+}
+
+TEST(VectorOfOptional, RelocatableEraseAndEmplace) {
+  misc::VectorOfOptional<size_t> v;
+  std::vector<std::optional<size_t>> expected;
+  size_t seed = 1;
+  for (size_t i = 0; i < 500; ++i) {
+    seed = (seed * 6364136223846793005u + 1442695040888963407u);
+    const auto r = seed >> 33;
+    if (r % 5 == 0) {
+      v.emplace_back(std::nullopt);
+      expected.emplace_back();
+    } else if (r % 7 == 0 && !expected.empty()) {
+      const auto pos = r % expected.size();
+      v.erase(pos);
+      expected.erase(expected.begin() + static_cast<std::ptrdiff_t>(pos));
+    } else if (r % 3 == 0) {
+      const auto pos = r % (expected.size() + 1);
+      v.emplace(pos, i);
+      expected.emplace(expected.begin() + static_cast<std::ptrdiff_t>(pos), i);
+    } else {
+      v.emplace_back(i);
+      expected.emplace_back(i);
+    }
+
+    ASSERT_EQ(v.size(), expected.size());
+    for (size_t j = 0; j < expected.size(); ++j) {
+      if (expected[j]) {
+        ASSERT_NE(v[j], nullptr);
+        ASSERT_EQ(*v[j], *expected[j]);
+      } else {
+        ASSERT_EQ(v[j], nullptr);
+      }
+    }
+    ASSERT_EQ(v.next_set(v.size()), v.size());
+  }
+}
+
+TEST(VectorOfOptional, RelocatableNoMoves) {
+  Relocatable::moves = 0;
+  misc::VectorOfOptional<Relocatable> v;
+  for (size_t i = 0; i < 100; ++i) {
+    v.emplace_back(i);
+  }
+  v.emplace(10, size_t{1000});
+  v.erase(0);
+  v.reserve(1000);
+  EXPECT_EQ(Relocatable::moves, 0);
+  EXPECT_EQ(*v[9]->p, 1000);
+  EXPECT_EQ(*v[10]->p, 10);
+  EXPECT_EQ(*v[99]->p, 99);
+}
+
+TEST(VectorOfOptional, SummarizedOccupancy) {
+  misc::VectorOfOptional<size_t, misc::summarized_occupancy> v;
+  misc::VectorOfOptional<size_t> flat;
+  // Spans more than one top-level summary word
+  constexpr size_t n = 300'000;
+  v.resize(n);
+  flat.resize(n);
+  for (const size_t i : {size_t{1}, size_t{4095}, size_t{64 * 64 * 64 + 3},
+                         size_t{200'000}, n - 1}) {
+    v.emplace_at(i, i);
+    flat.emplace_at(i, i);
+  }
+
+  const auto set_slots = [](const auto& vec) {
+    std::vector<size_t> retval;
+    for (auto i = vec.first_set(); i != vec.size(); i = vec.next_set(i + 1)) {
+      retval.push_back(i);
+    }
+    return retval;
+  };
+  EXPECT_EQ(set_slots(v), set_slots(flat));
+  EXPECT_EQ(v.prev_set(n - 1), 64 * 64 * 64 + 3);
+  EXPECT_EQ(v.prev_set(64 * 64 * 64 + 3), 200'000);
+  EXPECT_EQ(v.prev_set(200'000), 4095);
+  EXPECT_EQ(v.prev_set(1), v.npos);
+
+  std::vector<size_t> visited;
+  v.for_each_set([&](size_t i, size_t value) {
+    EXPECT_EQ(i, value);
+    visited.push_back(i);
+  });
+  EXPECT_EQ(visited, set_slots(flat));
+
+  v.reset(200'000);
+  v.reset(n - 1);
+  EXPECT_EQ(v.next_set(64 * 64 * 64 + 4), v.size());
+  EXPECT_EQ(v.prev_set(64 * 64 * 64 + 3), 4095);
+  EXPECT_EQ(v.next_set(4096), 64 * 64 * 64 + 3);
+  v.erase(0);
+  EXPECT_EQ(v.first_set(), 0);
+  EXPECT_EQ(v.next_set(1), 4094);
+  v.emplace(0, size_t{7});
+  EXPECT_EQ(v.next_set(2), 4095);
+  v.clear();
+  EXPECT_EQ(v.first_set(), v.size());
+}
+
+TEST(VectorOfOptional, MemoryResource) {
+  CountingResource resource;
+  {
+    misc::VectorOfOptional<size_t> v(&resource);
+    EXPECT_EQ(v.get_memory_resource(), &resource);
+    for (size_t i = 0; i < 100; ++i) {
+      v.emplace_back(i);
+    }
+    v.emplace(0, size_t{1000});
+    v.reserve(1000);
+    EXPECT_GT(resource.allocations, 3);
+    EXPECT_GT(resource.live_bytes, 1000 * sizeof(size_t));
+
+    const auto allocations = resource.allocations;
+    const misc::VectorOfOptional<size_t> copy = v;
+    EXPECT_EQ(copy.get_memory_resource(), nullptr);
+    EXPECT_EQ(resource.allocations, allocations);
+
+    misc::VectorOfOptional<size_t> assigned(&resource);
+    assigned = copy;
+    EXPECT_EQ(assigned.get_memory_resource(), &resource);
+    EXPECT_EQ(*assigned[0], 1000);
+  }
+  EXPECT_EQ(resource.live_bytes, 0);
+}
+
+TEST(VectorOfOptional, MonotonicBuffer) {
+  std::pmr::monotonic_buffer_resource arena;
+  CountingResource resource(&arena);
+  misc::VectorOfOptional<std::pmr::string> v(&resource);
+  for (size_t i = 0; i < 100; ++i) {
+    v.emplace_back("a string that's too long for the small buffer");
+  }
+  const auto* last = v[99];
+  ASSERT_NE(last, nullptr);
+  EXPECT_EQ(*last, "a string that's too long for the small buffer");
+  EXPECT_GT(resource.allocations, 0);
+}
+
+TEST(VectorOfOptional, Niche) {
+  static_assert(misc::has_optional_niche_v<NodeIndex>);
+  static_assert(!misc::has_optional_niche_v<size_t>);
+
+  misc::VectorOfOptional<NodeIndex> v;
+  v.emplace_back(NodeIndex{3});
+  v.emplace_back(std::nullopt);
+  v.emplace_back(NodeIndex{5});
+  EXPECT_EQ(v.size(), 3);
+  EXPECT_EQ(v.count(), 2);
+  ASSERT_NE(v[0], nullptr);
+  EXPECT_EQ(*v[0], NodeIndex{3});
+  EXPECT_EQ(v[1], nullptr);
+  EXPECT_EQ(v.next_set(1), 2);
+  EXPECT_EQ(v.prev_set(2), 0);
+
+  v.emplace(1, NodeIndex{4});
+  EXPECT_EQ(v.next_set(1), 1);
+  v.erase(0);
+  v.reset(0);
+  EXPECT_EQ(v.first_set(), 2);
+  v.resize(10);
+  EXPECT_EQ(v.count(), 1);
+  EXPECT_EQ(v[9], nullptr);
+
+  const auto copy = v;
+  EXPECT_EQ(copy, v);
+  v.emplace_at(9, NodeIndex{9});
+  EXPECT_NE(copy, v);
+
+  auto it = copy.begin();
+  EXPECT_EQ(it++, copy.begin());
+  EXPECT_EQ(it, copy.begin() + 1);
+  it += 1;
+  ASSERT_NE(*it, nullptr);
+  EXPECT_EQ(it.operator->(), copy[2]);
+  EXPECT_EQ(it--, copy.end() - 8);
+  it -= 1;
+  EXPECT_EQ(it, copy.begin());
+  EXPECT_EQ(copy.end() - it, 10);
+
+  using nan = misc::nan_niche<double>;
+  EXPECT_TRUE(nan::is_empty(nan::empty_value()));
+  EXPECT_FALSE(nan::is_empty(std::numeric_limits<double>::infinity()));
+}
+
+TEST_F(VectorOfOptionalCountingFixture, Compact) {
+  misc::VectorOfOptional<TestElement> v;
+  v.resize(10);
+  for (const size_t i : {size_t{1}, size_t{4}, size_t{5}, size_t{9}}) {
+    v.emplace_at(i);
+  }
+  const auto moves = call_counts.move_constructor_calls;
+  const auto destructions = call_counts.destructor_calls;
+
+  const auto remap = v.compact();
+  constexpr auto npos = misc::VectorOfOptional<TestElement>::npos;
+  EXPECT_EQ(remap, (std::vector<size_t>{npos, 0, npos, npos, 1, 2, npos, npos,
+                                        npos, 3}));
+  EXPECT_EQ(v.size(), 4);
+  EXPECT_EQ(v.capacity(), 4);
+  EXPECT_EQ(v.count(), 4);
+  EXPECT_EQ(call_counts.move_constructor_calls, moves + 4);
+  EXPECT_EQ(call_counts.destructor_calls, destructions + 4);
+}
+
+namespace {
+struct ThrowingMove {
+  static inline int live = 0;
+  static inline int moves_left = 0;
+  // -1 once moved from
+  int value;
+
+  explicit ThrowingMove(int v) : value(v) { ++live; }
+  ThrowingMove(const ThrowingMove&) = delete;
+  ThrowingMove(ThrowingMove&& o) : value(o.value) {
+    if (moves_left-- == 0) throw std::runtime_error("move");
+    o.value = -1;
+    ++live;
+  }
+  ThrowingMove& operator=(const ThrowingMove&) = delete;
+  ThrowingMove& operator=(ThrowingMove&&) = default;
+  ~ThrowingMove() { --live; }
+};
+}  // namespace
+
+TEST(VectorOfOptional, CompactThrowingMove) {
+  {
+    misc::VectorOfOptional<ThrowingMove> v;
+    v.resize(6);
+    for (const int i : {1, 2, 4, 5}) {
+      v.emplace_at(static_cast<size_t>(i), i * 10);
+    }
+    ThrowingMove::moves_left = 2;
+    std::vector<size_t> remap;
+    EXPECT_THROW(v.compact(remap), std::runtime_error);
+    EXPECT_TRUE(remap.empty());
+    // The elements stay in their slots, and none were leaked. The two moved
+    // before the throw are left moved-from.
+    EXPECT_EQ(v.size(), 6);
+    EXPECT_EQ(v.count(), 4);
+    std::vector<int> values;
+    v.for_each_set([&](size_t, const ThrowingMove& t) {
+      values.push_back(t.value);
+    });
+    EXPECT_EQ(values, (std::vector<int>{-1, -1, 40, 50}));
+    EXPECT_EQ(ThrowingMove::live, 4);
+  }
+  EXPECT_EQ(ThrowingMove::live, 0);
+}
+
+TEST(VectorOfOptional, CompactRelocatable) {
+  Relocatable::moves = 0;
+  misc::VectorOfOptional<Relocatable, misc::summarized_occupancy> v;
+  constexpr size_t n = 1000;
+  for (size_t i = 0; i < n; ++i) {
+    v.emplace_back(i);
+  }
+  for (size_t i = 0; i < n; ++i) {
+    if (i % 3 == 0 || (i >= 100 && i < 300)) v.reset(i);
+  }
+
+  std::vector<size_t> remap;
+  v.compact(remap);
+  EXPECT_EQ(Relocatable::moves, 0);
+  ASSERT_EQ(remap.size(), n);
+  EXPECT_EQ(v.size(), v.count());
+  EXPECT_EQ(v.capacity(), v.count());
+  for (size_t i = 0; i < n; ++i) {
+    if (remap[i] == v.npos) continue;
+    ASSERT_NE(v[remap[i]], nullptr);
+    EXPECT_EQ(*v[remap[i]]->p, i);
+  }
+  EXPECT_EQ(v.next_set(0), 0);
+  EXPECT_EQ(v.prev_set(v.size() - 1), v.size() - 2);
+
+  misc::VectorOfOptional<NodeIndex> niche;
+  niche.resize(5);
+  niche.emplace_at(3, NodeIndex{3});
+  EXPECT_EQ(niche.compact(), (std::vector<size_t>{v.npos, v.npos, v.npos, 0,
+                                                  v.npos}));
+  ASSERT_NE(niche[0], nullptr);
+  EXPECT_EQ(*niche[0], NodeIndex{3});
+  EXPECT_EQ(niche.size(), 1);
+
+  v.clear();
+  EXPECT_EQ(v.compact(), std::vector<size_t>{});
+  EXPECT_EQ(v.capacity(), 0);
+}